@@ -0,0 +1,89 @@
+// Compares the cost of closing a span under each BufferMode.
+//
+// Usage: bench_buffer_modes [output_path] [spans_per_thread]
+//
+// Output defaults to /dev/null so we measure the tracer, not the disk.
+// Buffers are sized to hold the largest run whole, so the modes are compared
+// on the cost of a push rather than of a drop. Any drops that remain (e.g.
+// threads piling onto one CPU's ring) are still reported.
+
+#include <tinytrace/tinytrace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace tinytrace;
+
+namespace {
+
+const char* mode_name(BufferMode mode) {
+    switch (mode) {
+    case BufferMode::direct: return "direct";
+    case BufferMode::per_cpu: return "per_cpu";
+    case BufferMode::mpsc: return "mpsc";
+    }
+    return "?";
+}
+
+double run(int num_threads, int spans_per_thread) {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([spans_per_thread]() {
+            for (int j = 0; j < spans_per_thread; ++j) {
+                TraceSpan span("bench_span");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double total = static_cast<double>(num_threads) * spans_per_thread;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / total;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string output = argc > 1 ? argv[1] : "/dev/null";
+    int spans_per_thread = argc > 2 ? std::atoi(argv[2]) : 20000;
+
+    set_trace_output(output);
+
+    const BufferMode modes[] = {BufferMode::direct, BufferMode::mpsc, BufferMode::per_cpu};
+    const int thread_counts[] = {1, 4, 16, 64};
+
+    // A buffer's capacity is fixed when the mode is first used, so size it
+    // for the biggest run: mpsc takes the total, per_cpu each CPU's share
+    // with 2x headroom for uneven scheduling.
+    std::size_t largest_run = static_cast<std::size_t>(thread_counts[3]) * spans_per_thread;
+    std::size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    auto capacity_for = [&](BufferMode mode) {
+        return mode == BufferMode::per_cpu ? 2 * ((largest_run + cpus - 1) / cpus)
+                                           : largest_run;
+    };
+
+    std::printf("%-8s %8s %14s %10s\n", "mode", "threads", "ns/span(wall)", "dropped");
+    for (BufferMode mode : modes) {
+        set_buffer_mode(mode, capacity_for(mode));
+        for (int threads : thread_counts) {
+            uint64_t dropped_before = TraceBackend::instance().dropped_spans();
+            double ns = run(threads, spans_per_thread);
+            flush_traces();
+            uint64_t dropped = TraceBackend::instance().dropped_spans() - dropped_before;
+            std::printf("%-8s %8d %14.1f %10llu\n", mode_name(mode), threads, ns,
+                        static_cast<unsigned long long>(dropped));
+        }
+    }
+    set_buffer_mode(BufferMode::direct);
+
+    return 0;
+}
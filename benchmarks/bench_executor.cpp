@@ -0,0 +1,57 @@
+// Measures TracedExecutor throughput on empty tasks, outside any trace
+// (counters only) and inside a sampled trace (queue/run spans emitted).
+//
+// Usage: bench_executor [output_path] [tasks]
+
+#include <tinytrace/tinytrace.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace tinytrace;
+
+namespace {
+
+double run(std::size_t workers, int tasks, bool traced) {
+    TracedExecutor pool("bench_pool", workers);
+    auto start = std::chrono::steady_clock::now();
+    if (traced) {
+        TraceSpan root("bench_root");
+        for (int i = 0; i < tasks; ++i) {
+            pool.submit([]() {});
+        }
+        pool.wait_idle();
+    } else {
+        for (int i = 0; i < tasks; ++i) {
+            pool.submit([]() {});
+        }
+        pool.wait_idle();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / tasks;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string output = argc > 1 ? argv[1] : "/dev/null";
+    int tasks = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+    set_trace_output(output);
+    set_buffer_mode(BufferMode::mpsc, 1 << 16);
+
+    const std::size_t worker_counts[] = {1, 4, 16};
+
+    std::printf("%8s %8s %14s\n", "workers", "traced", "ns/task(wall)");
+    for (std::size_t workers : worker_counts) {
+        for (bool traced : {false, true}) {
+            double ns = run(workers, tasks, traced);
+            flush_traces();
+            std::printf("%8zu %8s %14.1f\n", workers, traced ? "yes" : "no", ns);
+        }
+    }
+    set_buffer_mode(BufferMode::direct);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Compares a TT_LOG call and a span event with a span open/close (with an
+// owned and a StaticName name) and with formatting the same line eagerly,
+// as a synchronous logger would before any I/O.
+//
+// Usage: bench_logging [output_path] [iterations]
+//
+// Records go to the mpsc buffer; the buffer is sized to hold every record
+// so no call is measured as a cheap drop.
+
+#include <tinytrace/tinytrace.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace tinytrace;
+
+namespace {
+
+template <typename F>
+double time_per_call(int iterations, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    flush_traces();
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string output = argc > 1 ? argv[1] : "/dev/null";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+    set_trace_output(output);
+    set_buffer_mode(BufferMode::mpsc, static_cast<std::size_t>(iterations) * 2);
+    const std::string key = "user:1234";
+
+    double span_ns = time_per_call(iterations, [](int) { TraceSpan span("bench_span"); });
+    double static_span_ns = time_per_call(iterations, [](int) {
+        BasicTraceSpan<clock_type, StaticName> span("bench_static_span");
+    });
+    double log_ns = time_per_call(iterations, [&key](int i) {
+        TT_LOG(info, "cache miss for {} after {}us (attempt {})", key, i, 0.25);
+    });
+    double event_ns = 0;
+    {
+        TraceSpan owner("bench_event_owner");
+        event_ns = time_per_call(iterations, [&owner, &key](int) {
+            owner.event("cache_miss", "key", key);
+        });
+    }
+    volatile std::size_t sink = 0;
+    double eager_ns = time_per_call(iterations, [&key, &sink](int i) {
+        char line[128];
+        sink = sink + static_cast<std::size_t>(
+                          std::snprintf(line, sizeof(line), "cache miss for %s after %dus (attempt %g)",
+                                        key.c_str(), i, 0.25));
+    });
+
+    std::printf("%-22s %10s\n", "operation", "ns/call");
+    std::printf("%-22s %10.1f\n", "TraceSpan open+close", span_ns);
+    std::printf("%-22s %10.1f\n", "StaticName span", static_span_ns);
+    std::printf("%-22s %10.1f\n", "TT_LOG (3 args)", log_ns);
+    std::printf("%-22s %10.1f\n", "span.event (1 attr)", event_ns);
+    std::printf("%-22s %10.1f\n", "snprintf only", eager_ns);
+    std::printf("dropped: %llu\n",
+                static_cast<unsigned long long>(TraceBackend::instance().dropped_spans()));
+    set_buffer_mode(BufferMode::direct);
+
+    return 0;
+}
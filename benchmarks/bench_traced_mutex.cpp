@@ -0,0 +1,76 @@
+// Compares TracedMutex with a plain std::mutex, uncontended and contended.
+//
+// Usage: bench_traced_mutex [output_path] [iterations_per_thread]
+//
+// Contended runs emit a wait span per blocked acquisition; output defaults
+// to /dev/null so that cost is the tracer's, not the disk's.
+
+#include <tinytrace/tinytrace.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace tinytrace;
+
+namespace {
+
+template <typename Mutex>
+double run(Mutex& mutex, int num_threads, int iterations) {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    uint64_t counter = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&mutex, &counter, iterations]() {
+            for (int j = 0; j < iterations; ++j) {
+                std::lock_guard<Mutex> lock(mutex);
+                ++counter;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double total = static_cast<double>(num_threads) * iterations;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / total;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string output = argc > 1 ? argv[1] : "/dev/null";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+    set_trace_output(output);
+    set_buffer_mode(BufferMode::mpsc, 1 << 16);
+
+    const int thread_counts[] = {1, 4, 16};
+
+    std::printf("%-12s %8s %14s\n", "mutex", "threads", "ns/lock(wall)");
+    for (int threads : thread_counts) {
+        std::mutex plain;
+        TracedMutex traced("bench_lock");
+        double plain_ns = run(plain, threads, iterations / threads);
+        double traced_ns = run(traced, threads, iterations / threads);
+        std::printf("%-12s %8d %14.1f\n", "std::mutex", threads, plain_ns);
+        std::printf("%-12s %8d %14.1f\n", "TracedMutex", threads, traced_ns);
+    }
+    flush_traces();
+
+    for (const auto& stats : lock_stats()) {
+        std::printf("%s: contended=%llu p50_hold<=%lluns p99_hold<=%lluns\n",
+                    stats.name.c_str(), static_cast<unsigned long long>(stats.contended),
+                    static_cast<unsigned long long>(stats.hold_percentile_ns(0.5)),
+                    static_cast<unsigned long long>(stats.hold_percentile_ns(0.99)));
+    }
+    set_buffer_mode(BufferMode::direct);
+
+    return 0;
+}
@@ -51,12 +51,13 @@ public:
         TraceSpan rpc_span("rpc_fetch_user");
 
         {
-            TraceSpan serialize("serialize_request");
+            // Debug-level detail: compiled out with -DTINYTRACE_MIN_LEVEL=2
+            TRACE_SPAN_CAT(rpc, debug, "serialize_request");
             std::this_thread::sleep_for(std::chrono::microseconds(50));
         }
 
         {
-            TraceSpan network("network_roundtrip");
+            TRACE_SPAN_CAT(net, info, "network_roundtrip");
             // Simulate variable network latency
             std::random_device rd;
             std::mt19937 gen(rd());
@@ -65,7 +66,7 @@ public:
         }
 
         {
-            TraceSpan deserialize("deserialize_response");
+            TRACE_SPAN_CAT(rpc, debug, "deserialize_response");
             std::this_thread::sleep_for(std::chrono::microseconds(50));
         }
 
@@ -97,25 +98,20 @@ public:
         TraceSpan span("user_service_get");
 
         // Try cache first
-        {
-            auto cached = cache_.get(user_id);
-            if (cached) {
-                TraceSpan cache_hit("cache_hit");
-                return *cached;
-            }
+        auto cached = cache_.get(user_id);
+        if (cached) {
+            span.event("cache_hit", "user_id", user_id);
+            return *cached;
         }
 
         // Cache miss - fetch from RPC
-        {
-            TraceSpan cache_miss("cache_miss");
+        span.event("cache_miss", "user_id", user_id);
+        std::string user_data = rpc_.fetch_user_data(user_id);
 
-            std::string user_data = rpc_.fetch_user_data(user_id);
+        // Populate cache for next time
+        cache_.put(user_id, user_data);
 
-            // Populate cache for next time
-            cache_.put(user_id, user_data);
-
-            return user_data;
-        }
+        return user_data;
     }
 
     void notify_user(int user_id, const std::string& message) {
@@ -223,8 +219,8 @@ int main() {
 
     std::cout << "---\n\n";
     std::cout << "Analysis tips:\n";
-    std::cout << "  1. Find cache hits: grep for 'cache_hit'\n";
-    std::cout << "  2. Find cache misses: grep for 'cache_miss'\n";
+    std::cout << "  1. Find cache hits: grep for '\"name\":\"cache_hit\"' events\n";
+    std::cout << "  2. Find cache misses: grep for '\"name\":\"cache_miss\"' events\n";
     std::cout << "  3. Measure RPC latency: look at 'network_roundtrip' durations\n";
     std::cout << "  4. Compare cache vs RPC: cache_get (~100us) vs rpc_fetch_user (~5-20ms)\n";
     std::cout << "  5. Thread isolation: different thread_ids have independent span trees\n";
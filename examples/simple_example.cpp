@@ -45,7 +45,7 @@ int main() {
     std::cout << "  - span_id: unique ID\n";
     std::cout << "  - parent_id: parent span ID (0 = root)\n";
     std::cout << "  - duration_us: duration in microseconds\n";
-    std::cout << "  - thread_id: thread that created the span\n";
+    std::cout << "  - thread_id: index of the thread that created the span\n";
 
     return 0;
 }
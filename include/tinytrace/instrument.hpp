@@ -0,0 +1,47 @@
+#pragma once
+
+// Function-entry instrumentation for code that cannot be annotated by hand.
+//
+// Link the tinytrace_instrument library and compile the code of interest
+// with -finstrument-functions: every call then becomes a span keyed by the
+// function's address. The hooks never allocate or format; names are
+// resolved from the ELF symbol tables by the writer at export time.
+
+#include <tinytrace/tinytrace.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tinytrace {
+namespace instrument {
+
+// Start recording instrumented calls. Records only travel through the
+// buffered pipeline, so a backend still in direct mode is switched to
+// `mode`. Setting TINYTRACE_INSTRUMENT=1 starts recording before main().
+void start(BufferMode mode = BufferMode::mpsc);
+void stop();
+bool running();
+
+// Filters. With no include rules every function is recorded; otherwise
+// only functions matching one of them. Exclude rules always win.
+// Prefixes match demangled names ("myapp::net::") or raw symbol names and
+// are resolved to address ranges when set, never on the hot path.
+void include_range(const void* begin, const void* end);
+void exclude_range(const void* begin, const void* end);
+void include_symbol_prefix(std::string_view prefix);
+void exclude_symbol_prefix(std::string_view prefix);
+void clear_filters();
+
+// Re-resolve symbol prefixes, e.g. after dlopen() brought in new code.
+void refresh_filters();
+
+// Name of the function containing `address`, as the exporter writes it.
+std::string symbolize(const void* address);
+
+// Records lost because no buffer was active when they closed. Records lost
+// to a full buffer are counted by TraceBackend::dropped_spans().
+uint64_t dropped();
+
+} // namespace instrument
+} // namespace tinytrace
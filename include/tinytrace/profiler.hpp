@@ -0,0 +1,39 @@
+#pragma once
+
+// Span-tagged sampling CPU profiler (Linux x86-64 / aarch64).
+//
+// Each profiled thread gets its own CPU-time timer (timer_create with
+// CLOCK_THREAD_CPUTIME_ID) that sends it SIGPROF. The handler walks the
+// frame-pointer chain and pushes a sample record, tagged with the span the
+// thread has open, into the same buffer as the spans. The writer exports
+// it as {"type":"sample","span_id":...,"stack":[...]} with symbolized
+// frames, so hotspots can be grouped by span. Build the code of interest
+// with -fno-omit-frame-pointer, or stacks stop at the first frame without one.
+
+#include <tinytrace/tinytrace.hpp>
+
+#include <cstdint>
+
+namespace tinytrace {
+namespace profiler {
+
+// Start sampling at `frequency_hz` per thread of CPU time. The calling
+// thread and every thread that opens its first span afterwards are
+// profiled; call register_thread() on threads that were already tracing.
+// Samples use the lock-free buffers, so a direct-mode backend is switched
+// to `mode`.
+void start(int frequency_hz = 100, BufferMode mode = BufferMode::mpsc);
+void stop();
+bool running();
+
+// Profile the calling thread until it exits or stop() is called.
+void register_thread();
+void unregister_thread();
+
+// Samples taken, and samples lost because no signal-safe buffer was active.
+// Samples lost to a full buffer are counted by TraceBackend::dropped_spans().
+uint64_t samples();
+uint64_t dropped();
+
+} // namespace profiler
+} // namespace tinytrace
@@ -1,18 +1,88 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+// Restartable sequences: glibc >= 2.35 registers an rseq area for every
+// thread and exports its offset from the thread pointer. The per-CPU commit
+// below is hand-written x86-64 asm; every other platform takes the
+// sched_getcpu() + per-CPU lock path.
+#if !defined(TINYTRACE_HAVE_RSEQ)
+#if defined(__linux__) && defined(__x86_64__) && defined(__GLIBC__) && \
+    __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#if defined(RSEQ_SIG)
+#define TINYTRACE_HAVE_RSEQ 1
+#endif
+#endif
+#endif
+#if !defined(TINYTRACE_HAVE_RSEQ)
+#define TINYTRACE_HAVE_RSEQ 0
+#endif
+
+// Self-patching span sites (see SpanSite). The patcher is compiled on every
+// supported target so all translation units agree on SiteRegistry; only the
+// TRACE_SPAN expansion depends on the opt-in TINYTRACE_JUMP_LABELS. Shared
+// library (non-PIE PIC) code cannot take a site's address as an asm
+// immediate, so it keeps the atomic-flag path.
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#define TINYTRACE_HAVE_JUMP_PATCHING 1
+#include <sys/mman.h>
+#else
+#define TINYTRACE_HAVE_JUMP_PATCHING 0
+#endif
+
+#if defined(TINYTRACE_JUMP_LABELS) && TINYTRACE_JUMP_LABELS && \
+    TINYTRACE_HAVE_JUMP_PATCHING && (!defined(__PIC__) || defined(__PIE__))
+#define TINYTRACE_USE_JUMP_LABELS 1
+#else
+#define TINYTRACE_USE_JUMP_LABELS 0
+#endif
+
 namespace tinytrace {
 
 using clock_type = std::chrono::steady_clock;
@@ -23,14 +93,306 @@ using duration_us = std::chrono::microseconds;
 // TraceContext - thread-local state for managing span nesting
 // ============================================================================
 
-struct SpanData {
-    std::string name;
+template <typename Name = std::string, typename TimePoint = time_point>
+struct BasicSpanData {
+    Name name;
     uint64_t span_id;
     uint64_t parent_id;
-    time_point start_time;
-    std::thread::id thread_id;
+    TimePoint start_time; // the span's ClockPolicy time
+    uint32_t thread_id; // thread index, see ThreadRegistry
+};
+
+using SpanData = BasicSpanData<>;
+
+namespace detail {
+// Head-sampling coin flip (xorshift64*); `state` must be non-zero.
+inline bool sample_coin(uint64_t& state, double rate) {
+    if (rate >= 1.0) {
+        return true;
+    }
+    if (rate <= 0.0) {
+        return false;
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint64_t r = state * 0x2545F4914F6CDD1DULL;
+    return static_cast<double>(r >> 11) * (1.0 / 9007199254740992.0) < rate;
+}
+} // namespace detail
+
+// ============================================================================
+// OpenSpanStack - each thread's open spans, readable from other threads
+// ============================================================================
+//
+// A seqlock with the sequence folded into the depth word: `state_` holds
+// (generation << 32 | depth). Opening a span fills the slot above the top
+// and bumps the depth; closing one drops the depth and bumps the
+// generation, since only a close makes a slot reusable. Both are plain
+// stores on x86. A reader copies the slots below the depth and retries if
+// the state word moved meanwhile.
+
+// A copy of one open span, taken by OpenSpanStack::snapshot().
+struct OpenSpan {
+    uint64_t span_id = 0;
+    uint64_t parent_id = 0;
+    std::string name;
+    int64_t start_ns = 0; // detail::now_ns() clock
+    uint32_t thread_id = 0; // thread index
+};
+
+class OpenSpanStack {
+public:
+    static constexpr uint32_t kCapacity = 64; // deeper spans are not published
+    static constexpr std::size_t kMaxNameCopy = 128;
+
+    // `name` must stay valid until the matching pop().
+    void push(uint64_t span_id, uint64_t parent_id, const char* name, int64_t start_ns) {
+        uint64_t state = state_.load(std::memory_order_relaxed);
+        uint32_t depth = static_cast<uint32_t>(state);
+        if (depth < kCapacity) {
+            // Keeps the slot stores after the close that freed the slot.
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = slots_[depth];
+            slot.span_id.store(span_id, std::memory_order_relaxed);
+            slot.parent_id.store(parent_id, std::memory_order_relaxed);
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        }
+        state_.store(state + 1, std::memory_order_release);
+    }
+
+    void pop() {
+        uint64_t state = state_.load(std::memory_order_relaxed);
+        if (static_cast<uint32_t>(state) != 0) {
+            state_.store(state + (1ULL << 32) - 1, std::memory_order_release);
+        }
+    }
+
+    // Appends this stack, outermost first, to `out`. Gives up (returning
+    // false) only if the owner keeps changing it across many retries.
+    bool snapshot(std::vector<OpenSpan>& out, uint32_t owner) const {
+        std::size_t keep = out.size();
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            out.resize(keep);
+            uint64_t before = state_.load(std::memory_order_acquire);
+            uint32_t depth = std::min(static_cast<uint32_t>(before), kCapacity);
+            for (uint32_t i = 0; i < depth; ++i) {
+                const Slot& slot = slots_[i];
+                OpenSpan span;
+                span.span_id = slot.span_id.load(std::memory_order_relaxed);
+                span.parent_id = slot.parent_id.load(std::memory_order_relaxed);
+                span.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+                span.thread_id = owner;
+                if (const char* name = slot.name.load(std::memory_order_relaxed)) {
+                    // May race with the span closing; the state check below
+                    // discards anything read from a closed span.
+                    for (std::size_t n = 0; n < kMaxNameCopy && name[n]; ++n) {
+                        span.name.push_back(name[n]);
+                    }
+                }
+                out.push_back(std::move(span));
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (state_.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+        out.resize(keep);
+        return false;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> span_id{0};
+        std::atomic<uint64_t> parent_id{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<int64_t> start_ns{0};
+    };
+
+    std::atomic<uint64_t> state_{0};
+    Slot slots_[kCapacity];
+};
+
+// Every live thread's OpenSpanStack. Threads join on their first span and
+// leave at exit; readers hold the lock, so a stack never disappears under
+// them.
+class OpenSpanRegistry {
+public:
+    // Leaked on purpose: threads still exiting during static destruction
+    // unregister here.
+    static OpenSpanRegistry& instance() {
+        static OpenSpanRegistry* registry = new OpenSpanRegistry();
+        return *registry;
+    }
+
+    void add(const OpenSpanStack* stack, uint32_t owner) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stacks_.push_back({stack, owner});
+    }
+
+    void remove(const OpenSpanStack* stack) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stacks_.erase(std::remove_if(stacks_.begin(), stacks_.end(),
+                                     [stack](const Entry& e) { return e.stack == stack; }),
+                      stacks_.end());
+    }
+
+    // All open spans of all threads, each thread's outermost first.
+    std::vector<OpenSpan> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<OpenSpan> out;
+        for (const Entry& e : stacks_) {
+            e.stack->snapshot(out, e.owner);
+        }
+        return out;
+    }
+
+    // fork() support: hold the lock across the fork; in the child, forget
+    // the stacks of threads that did not survive it.
+    void lock_for_fork() { mutex_.lock(); }
+    void unlock_after_fork(bool child, uint32_t self) {
+        if (child) {
+            stacks_.erase(std::remove_if(stacks_.begin(), stacks_.end(),
+                                         [self](const Entry& e) { return e.owner != self; }),
+                          stacks_.end());
+        }
+        mutex_.unlock();
+    }
+
+private:
+    struct Entry {
+        const OpenSpanStack* stack;
+        uint32_t owner;
+    };
+
+    OpenSpanRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> stacks_;
+};
+
+// ============================================================================
+// ThreadRegistry - small dense thread indices
+// ============================================================================
+//
+// Each thread takes the next index the first time it records anything, and
+// records carry only that index. A {"type":"thread"} record, written when
+// the thread registers or is renamed and again at the top of every newly
+// opened output file, maps the index to the OS thread id and name.
+
+struct ThreadInfo {
+    uint32_t index = 0;
+    int64_t tid = 0; // OS thread id
+    std::string name;
+};
+
+namespace detail {
+inline int64_t os_thread_id() {
+#if defined(__linux__)
+    return static_cast<int64_t>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+}
+
+inline std::string os_thread_name() {
+#if defined(__linux__)
+    char name[16] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+        return name;
+    }
+#endif
+    return {};
+}
+} // namespace detail
+
+class ThreadRegistry {
+public:
+    // Leaked on purpose, like OpenSpanRegistry.
+    static ThreadRegistry& instance() {
+        static ThreadRegistry* registry = new ThreadRegistry();
+        return *registry;
+    }
+
+    // Registers the calling thread under `index`.
+    ThreadInfo add(uint32_t index) {
+        ThreadInfo info{index, detail::os_thread_id(), detail::os_thread_name()};
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(info);
+        return info;
+    }
+
+    ThreadInfo rename(uint32_t index, std::string_view name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ThreadInfo& info : threads_) {
+            if (info.index == index) {
+                info.name = std::string(name);
+                return info;
+            }
+        }
+        return {};
+    }
+
+    // Every thread registered so far, including ones that have exited
+    // since: their records may still be waiting in the buffers.
+    std::vector<ThreadInfo> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return threads_;
+    }
+
+    // fork() support, as for OpenSpanRegistry. The forking thread keeps its
+    // index in the child but has a new OS thread id there.
+    void lock_for_fork() { mutex_.lock(); }
+    void unlock_after_fork(bool child, uint32_t self) {
+        if (child) {
+            for (ThreadInfo& info : threads_) {
+                if (info.index == self) {
+                    info.tid = detail::os_thread_id();
+                }
+            }
+        }
+        mutex_.unlock();
+    }
+
+private:
+    ThreadRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::vector<ThreadInfo> threads_;
 };
 
+namespace detail {
+// Zero until the thread registers. Constant-initialized, so it is safe to
+// read from signal handlers and during thread exit.
+inline thread_local uint32_t t_thread_index = 0;
+
+// Takes the next index and writes the thread record (defined after
+// TraceBackend).
+inline uint32_t register_thread_index();
+
+inline uint32_t thread_index() {
+    uint32_t index = t_thread_index;
+    return index != 0 ? index : register_thread_index();
+}
+} // namespace detail
+
+class TraceContext;
+
+constexpr uint32_t kOverheadSampleInterval = 1024;
+
+namespace detail {
+// Set by the profiler: run when a thread's TraceContext is created and
+// destroyed, so a thread is profiled from its first span until it exits.
+using ThreadHook = void (*)(TraceContext*);
+inline std::atomic<ThreadHook> thread_start_hook{nullptr};
+inline std::atomic<ThreadHook> thread_exit_hook{nullptr};
+
+// This thread's TraceContext from construction to destruction, for hooks
+// that must read it without creating it.
+inline thread_local TraceContext* current_context = nullptr;
+} // namespace detail
+
 class TraceContext {
 public:
     static TraceContext& instance() {
@@ -38,131 +400,4501 @@ public:
         return ctx;
     }
 
-    uint64_t current_span_id() const { return current_span_id_; }
+    // This thread's index. Also safe to call from a signal handler.
+    uint32_t thread_index() const { return thread_index_; }
+
+    // Also safe to call from a signal handler on this thread.
+    uint64_t current_span_id() const {
+        return current_span_id_.load(std::memory_order_relaxed);
+    }
+
+    // Whether the innermost open span belongs to a sampled trace.
+    bool current_sampled() const { return current_sampled_; }
+
+    void push_span(uint64_t span_id, bool sampled = true) {
+        span_stack_.push_back({span_id, sampled, false});
+        current_span_id_.store(span_id, std::memory_order_relaxed);
+        current_sampled_ = sampled;
+    }
 
-    void push_span(uint64_t span_id) {
-        span_stack_.push_back(span_id);
-        current_span_id_ = span_id;
+    // Returns whether the popped span was marked by keep_current().
+    bool pop_span() {
+        if (span_stack_.empty()) {
+            return false;
+        }
+        bool keep = span_stack_.back().keep;
+        span_stack_.pop_back();
+        current_span_id_.store(span_stack_.empty() ? 0 : span_stack_.back().span_id,
+                               std::memory_order_relaxed);
+        current_sampled_ = span_stack_.empty() || span_stack_.back().sampled;
+        return keep;
     }
 
-    void pop_span() {
+    // Marks the innermost open span to be written even if its trace was
+    // sampled out, because something under it failed.
+    void keep_current() {
         if (!span_stack_.empty()) {
-            span_stack_.pop_back();
-            current_span_id_ = span_stack_.empty() ? 0 : span_stack_.back();
+            span_stack_.back().keep = true;
+        }
+    }
+
+    // Head-sampling coin flip for a new root span.
+    bool sample(double rate) { return detail::sample_coin(rng_state_, rate); }
+
+    // This thread's named, timed spans, published for the watchdog.
+    OpenSpanStack& open_spans() { return open_spans_; }
+
+    // True for every kOverheadSampleInterval-th span on this thread, which
+    // then times its own bookkeeping for the tracer's overhead estimate.
+    bool sample_overhead() {
+        if (--overhead_countdown_ != 0) {
+            return false;
         }
+        overhead_countdown_ = kOverheadSampleInterval;
+        return true;
     }
 
 private:
-    TraceContext() = default;
-    std::vector<uint64_t> span_stack_;
-    uint64_t current_span_id_ = 0;
+    struct Frame {
+        uint64_t span_id;
+        bool sampled;
+        bool keep;
+    };
+
+    TraceContext()
+        : thread_index_(detail::thread_index()),
+          rng_state_((std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                      static_cast<uint64_t>(
+                          std::chrono::steady_clock::now().time_since_epoch().count())) |
+                     1) {
+        OpenSpanRegistry::instance().add(&open_spans_, thread_index_);
+        detail::current_context = this;
+        if (detail::ThreadHook hook = detail::thread_start_hook.load(std::memory_order_acquire)) {
+            hook(this);
+        }
+    }
+
+    ~TraceContext() {
+        detail::current_context = nullptr;
+        OpenSpanRegistry::instance().remove(&open_spans_);
+        if (detail::ThreadHook hook = detail::thread_exit_hook.load(std::memory_order_acquire)) {
+            hook(this);
+        }
+    }
+
+    TraceContext(const TraceContext&) = delete;
+    TraceContext& operator=(const TraceContext&) = delete;
+
+    uint32_t thread_index_;
+    std::vector<Frame> span_stack_;
+    std::atomic<uint64_t> current_span_id_{0};
+    bool current_sampled_ = true;
+    uint64_t rng_state_;
+    uint32_t overhead_countdown_ = kOverheadSampleInterval;
+    OpenSpanStack open_spans_;
+};
+
+namespace detail {
+// Process-wide span ids, shared by TraceSpan and function instrumentation
+// so every record in a trace is unique.
+inline uint64_t next_span_id() {
+    static std::atomic<uint64_t> counter{1};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// clock_type as a plain integer, for timestamps carried between threads.
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               clock_type::now().time_since_epoch())
+        .count();
+}
+
+struct OpenFrame {
+    uint64_t span_id; // 0 = none
+    bool sampled;
 };
 
+// Set by function instrumentation while it runs: the innermost instrumented
+// call open on this thread.
+using OpenFrameHook = OpenFrame (*)();
+inline std::atomic<OpenFrameHook> open_frame_hook{nullptr};
+
+// The span new work on this thread nests under: the innermost TraceSpan or
+// instrumented call. Both nest on one thread and ids only grow, so the
+// newer id is the inner one.
+inline OpenFrame innermost_open_span(const TraceContext& ctx) {
+    OpenFrame open{ctx.current_span_id(), ctx.current_sampled()};
+    if (OpenFrameHook hook = open_frame_hook.load(std::memory_order_acquire)) {
+        OpenFrame frame = hook();
+        if (frame.span_id > open.span_id) {
+            open = frame;
+        }
+    }
+    return open;
+}
+} // namespace detail
+
 // ============================================================================
-// TraceBackend - handles output (stdout or file)
+// Categories and levels
 // ============================================================================
+//
+// TRACE_SPAN_CAT(net, debug, "network_roundtrip") tags a site with a category
+// and a verbosity level. Two filters apply:
+//   - build time: sites whose level is below TINYTRACE_MIN_LEVEL or whose
+//     category bit is clear in TINYTRACE_COMPILED_CATEGORIES expand to an
+//     empty object, so neither the span nor its name reaches the binary;
+//   - run time: the backend's category mask (one relaxed load) switches the
+//     remaining categories on and off.
+// Plain TRACE_SPAN / TraceSpan use categories::general at Level::info.
 
-class TraceBackend {
+enum class Level : uint8_t { trace = 0, debug = 1, info = 2, warn = 3, error = 4 };
+
+struct Category {
+    uint8_t bit; // 0..63
+    const char* name;
+};
+
+// Define an application category usable as TRACE_SPAN_CAT(name, ...).
+#define TINYTRACE_DEFINE_CATEGORY(cat, bit_index)                            \
+    namespace tinytrace {                                                     \
+    namespace categories {                                                    \
+    constexpr ::tinytrace::Category cat{bit_index, #cat};                     \
+    }                                                                         \
+    }
+
+namespace categories {
+constexpr Category general{0, "general"};
+constexpr Category net{1, "net"};
+constexpr Category io{2, "io"};
+constexpr Category db{3, "db"};
+constexpr Category cache{4, "cache"};
+constexpr Category rpc{5, "rpc"};
+constexpr Category sched{6, "sched"};
+constexpr Category lock{7, "lock"};
+} // namespace categories
+
+#if !defined(TINYTRACE_MIN_LEVEL)
+#define TINYTRACE_MIN_LEVEL 0 // Level::trace: keep everything
+#endif
+#if !defined(TINYTRACE_COMPILED_CATEGORIES)
+#define TINYTRACE_COMPILED_CATEGORIES (~0ULL)
+#endif
+
+constexpr int kMinLevel = TINYTRACE_MIN_LEVEL;
+
+// Whether the build-time filter keeps sites of this category and level.
+constexpr bool compiled_in(Category category, Level level) {
+    return static_cast<int>(level) >= kMinLevel &&
+           ((static_cast<unsigned long long>(TINYTRACE_COMPILED_CATEGORIES) >>
+             category.bit) & 1ULL) != 0;
+}
+
+// ============================================================================
+// SpanSite - static per-TRACE_SPAN descriptor with a runtime enable bit
+// ============================================================================
+//
+// Each TRACE_SPAN expands to a function-local static SpanSite. Its
+// constructor is constexpr, so the site is constant-initialized (no guard
+// variable) and costs nothing until it first runs; it registers itself in
+// the process-wide site list on that first run and picks up any enable
+// rules set so far. After that a span at a disabled site costs one relaxed
+// load and a predictable branch: no clock read, no span ID, no context push.
+
+class SpanSite {
 public:
-    static TraceBackend& instance() {
-        static TraceBackend backend;
-        return backend;
+    constexpr SpanSite(const char* name, const char* file, int line,
+                       uint8_t category = categories::general.bit,
+                       Level level = Level::info)
+        : name_(name), file_(file), line_(line), category_(category), level_(level) {}
+
+    SpanSite(const SpanSite&) = delete;
+    SpanSite& operator=(const SpanSite&) = delete;
+
+    // Hot path: true if spans at this site should be recorded.
+    bool enabled() {
+        uint8_t state = state_.load(std::memory_order_relaxed);
+        if (state == (kEnabled | kRegistered)) {
+            return true;
+        }
+        return (state & kRegistered) ? false : register_slow();
     }
 
-    void set_output_file(const std::string& path) {
+    void set_enabled(bool on) {
+        if (on) {
+            state_.fetch_or(kEnabled, std::memory_order_relaxed);
+        } else {
+            state_.fetch_and(static_cast<uint8_t>(~kEnabled), std::memory_order_relaxed);
+        }
+    }
+
+    const char* name() const { return name_; }
+    const char* file() const { return file_; }
+    int line() const { return line_; }
+    uint8_t category() const { return category_; }
+    Level level() const { return level_; }
+    SpanSite* next() const { return next_; }
+
+private:
+    friend class SiteRegistry;
+    static constexpr uint8_t kEnabled = 1;
+    static constexpr uint8_t kRegistered = 2;
+
+    bool register_slow();
+
+    const char* name_;
+    const char* file_;
+    int line_;
+    uint8_t category_;
+    Level level_;
+    std::atomic<uint8_t> state_{kEnabled};
+    SpanSite* next_ = nullptr;
+};
+
+namespace detail {
+
+#if TINYTRACE_HAVE_JUMP_PATCHING
+// One entry per jump-label TRACE_SPAN site, emitted by the asm in
+// TINYTRACE_SITE_LIVE into a section the linker brackets with
+// __start_/__stop_ symbols.
+struct JumpEntry {
+    uint64_t code;   // address of the 5-byte NOP, 8-byte aligned
+    uint64_t target; // where the patched jmp goes (the "site off" path)
+    uint64_t key;    // the SpanSite
+};
+#endif
+
+// Shell-style match supporting '*' and '?'.
+inline bool glob_match(std::string_view pattern, std::string_view text) {
+    std::size_t p = 0, t = 0, star = std::string_view::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+// TRACE_SPAN's name. A string literal names the static site; anything else
+// (std::string, a runtime const char*, a mutable buffer) is copied for each
+// span, like TraceSpan(name), and is not subject to site rules. Such sites
+// are named null: their static is initialized on first use, so the jump
+// table can see them zeroed either way.
+struct LiteralName {};
+
+template <std::size_t N>
+constexpr const char* site_name(const char (&name)[N]) {
+    return name;
+}
+template <std::size_t N>
+constexpr const char* site_name(char (&)[N]) {
+    return nullptr;
+}
+template <typename T>
+constexpr const char* site_name(const T&) {
+    return nullptr;
+}
+
+template <std::size_t N>
+constexpr LiteralName runtime_name(const char (&)[N]) {
+    return {};
+}
+template <std::size_t N>
+std::string runtime_name(char (&name)[N]) {
+    return name;
+}
+template <typename T>
+const T& runtime_name(const T& name) {
+    return name;
+}
+
+} // namespace detail
+
+#if TINYTRACE_HAVE_JUMP_PATCHING
+extern "C" {
+extern detail::JumpEntry __start___tinytrace_jump[] __attribute__((weak, visibility("hidden")));
+extern detail::JumpEntry __stop___tinytrace_jump[] __attribute__((weak, visibility("hidden")));
+}
+
+namespace detail {
+
+// Rewrite one site between the 5-byte NOP (fall through to the normal,
+// flag-checked span path) and `jmp rel32` straight past the span. The
+// instruction sits alone in an aligned quadword, so a single atomic 8-byte
+// store swaps it and a concurrently executing thread sees either version.
+// Returns false if the text page cannot be made writable (e.g. W^X policy);
+// the site's atomic flag still disables it in that case.
+inline bool patch_jump_site(const JumpEntry& entry, bool jump) {
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t code = static_cast<uintptr_t>(entry.code);
+    void* page = reinterpret_cast<void*>(code & ~static_cast<uintptr_t>(page_size - 1));
+    if (mprotect(page, static_cast<std::size_t>(page_size),
+                 PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
+        return false;
+    }
+    auto* word_ptr = reinterpret_cast<uint64_t*>(code);
+    uint64_t word = __atomic_load_n(word_ptr, __ATOMIC_RELAXED);
+    unsigned char bytes[8];
+    std::memcpy(bytes, &word, sizeof(bytes));
+    if (jump) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(entry.target) -
+                                           static_cast<int64_t>(entry.code + 5));
+        bytes[0] = 0xe9;
+        std::memcpy(bytes + 1, &rel, sizeof(rel));
+    } else {
+        static const unsigned char nop5[5] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+        std::memcpy(bytes, nop5, sizeof(nop5));
+    }
+    std::memcpy(&word, bytes, sizeof(word));
+    __atomic_store_n(word_ptr, word, __ATOMIC_SEQ_CST);
+    mprotect(page, static_cast<std::size_t>(page_size), PROT_READ | PROT_EXEC);
+    return true;
+}
+
+// Patch every jump-label site whose name matches `pattern`. Walks the
+// linker table, so it also covers sites that have never run.
+inline void patch_jump_sites(std::string_view pattern, bool enabled) {
+    if (!__start___tinytrace_jump) {
+        return;
+    }
+    for (JumpEntry* e = __start___tinytrace_jump; e != __stop___tinytrace_jump; ++e) {
+        // Runtime-named TRACE_SPANs have no site name and are never patched.
+        const auto* site = reinterpret_cast<const SpanSite*>(e->key);
+        if (site->name() && glob_match(pattern, site->name())) {
+            patch_jump_site(*e, !enabled);
+        }
+    }
+}
+
+} // namespace detail
+#endif
+
+class SiteRegistry {
+public:
+    static SiteRegistry& instance() {
+        static SiteRegistry registry;
+        return registry;
+    }
+
+    // Enable or disable every site whose name matches `pattern`, now and
+    // for sites that register later. Rules apply in order; "*" resets.
+    void set_enabled(std::string_view pattern, bool on) {
         std::lock_guard<std::mutex> lock(mutex_);
-        file_output_ = std::make_unique<std::ofstream>(path, std::ios::app);
-        use_file_ = file_output_ && file_output_->is_open();
+        if (pattern == "*") {
+            rules_.clear();
+        }
+        rules_.emplace_back(std::string(pattern), on);
+        for (SpanSite* site = head_; site; site = site->next_) {
+            if (detail::glob_match(pattern, site->name_)) {
+                site->set_enabled(on);
+            }
+        }
+#if TINYTRACE_HAVE_JUMP_PATCHING
+        detail::patch_jump_sites(pattern, on);
+#endif
     }
 
-    void write_span(const std::string& json) {
+    // Visit every registered site (e.g. to list them for an operator).
+    template <typename F>
+    void for_each(F&& fn) {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (use_file_ && file_output_) {
-            (*file_output_) << json << std::endl;
-        } else {
-            std::cout << json << std::endl;
+        for (SpanSite* site = head_; site; site = site->next_) {
+            fn(*site);
         }
     }
 
-    void flush() {
+    bool add(SpanSite& site) {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (use_file_ && file_output_) {
-            file_output_->flush();
-        } else {
-            std::cout.flush();
+        uint8_t state = site.state_.load(std::memory_order_relaxed);
+        if (state & SpanSite::kRegistered) {
+            return state & SpanSite::kEnabled;
+        }
+        bool on = true;
+        for (const auto& rule : rules_) {
+            if (detail::glob_match(rule.first, site.name_)) {
+                on = rule.second;
+            }
         }
+        site.next_ = head_;
+        head_ = &site;
+        site.state_.store(static_cast<uint8_t>(SpanSite::kRegistered |
+                                               (on ? SpanSite::kEnabled : 0)),
+                          std::memory_order_relaxed);
+        return on;
     }
 
 private:
-    TraceBackend() = default;
+    SiteRegistry() = default;
     std::mutex mutex_;
-    std::unique_ptr<std::ofstream> file_output_;
-    bool use_file_ = false;
+    SpanSite* head_ = nullptr;
+    std::vector<std::pair<std::string, bool>> rules_;
 };
 
+inline bool SpanSite::register_slow() {
+    return SiteRegistry::instance().add(*this);
+}
+
+
 // ============================================================================
-// TraceSpan - RAII span for measuring duration
+// SpanRecord - fixed-size, trivially copyable span used by buffered modes
 // ============================================================================
 
-class TraceSpan {
-public:
-    explicit TraceSpan(std::string name)
-        : data_{std::move(name), next_span_id(),
-                TraceContext::instance().current_span_id(),
-                clock_type::now(), std::this_thread::get_id()} {
-        TraceContext::instance().push_span(data_.span_id);
-    }
+constexpr std::size_t kRecordNameCapacity = 96;
 
-    ~TraceSpan() {
-        auto end_time = clock_type::now();
-        auto duration = std::chrono::duration_cast<duration_us>(end_time - data_.start_time);
+enum class RecordKind : uint8_t {
+    span,   // a closed span
+    sample, // a profiler stack sample taken while span_id was open
+    log,    // a TT_LOG line written while span_id was open
+    event,  // a point event on span_id (TraceSpan::event)
+    thread, // thread metadata: span_id = OS thread id, name = thread name
+    flow,   // one end of a flow: parent_id = flow id, see flow_begin()
+    counter, // a counter track value, see track_counter()
+};
 
-        TraceContext::instance().pop_span();
-        emit_span(duration);
-    }
+constexpr std::size_t kSampleMaxFrames = kRecordNameCapacity / sizeof(uint64_t);
 
-    // No copying or moving - RAII ownership
-    TraceSpan(const TraceSpan&) = delete;
-    TraceSpan& operator=(const TraceSpan&) = delete;
-    TraceSpan(TraceSpan&&) = delete;
-    TraceSpan& operator=(TraceSpan&&) = delete;
+// SpanRecord::flags bits.
+constexpr uint8_t kSpanOverBudget = 1; // closed later than its latency budget
+constexpr uint8_t kArgsTruncated = 2;  // arguments did not all fit the record
+constexpr uint8_t kSpanFormattedName = 4; // name = format at `address` + `args`
+constexpr uint8_t kSpanError = 8;         // failed; code and message follow the name
+constexpr uint8_t kFlowEnd = 16;          // flows: the consuming end
 
-    uint64_t span_id() const { return data_.span_id; }
-    uint64_t parent_id() const { return data_.parent_id; }
+struct alignas(8) SpanRecord {
+    uint64_t span_id;
+    uint64_t parent_id;
+    int64_t duration_ns;
+    uint32_t thread_id; // thread index, see ThreadRegistry
+    uint64_t address; // code address, symbolized at export; 0 = use name.
+                      // logs: the LogSite; events, flows, counters: the name;
+                      // kSpanFormattedName: the format
+    RecordKind kind = RecordKind::span;
+    uint8_t frame_count = 0; // samples: entries used in `frames`
+    uint8_t flags = 0;       // kSpanOverBudget, kArgsTruncated, kSpanFormattedName,
+                             // kSpanError, kFlowEnd
+    uint32_t budget_us = 0;  // set with kSpanOverBudget
+    union {
+        char name[kRecordNameCapacity]; // NUL-terminated, truncated if longer
+        uint64_t frames[kSampleMaxFrames]; // samples: leaf first; flow ends:
+                                           // frames[0] = begin timestamp;
+                                           // counters: frames[0] = double bits
+        char args[kRecordNameCapacity];    // logs, events, formatted names
+    };
 
-private:
-    static uint64_t next_span_id() {
-        static std::atomic<uint64_t> counter{1};
-        return counter.fetch_add(1, std::memory_order_relaxed);
+    void set_name(std::string_view n) {
+        std::size_t len = std::min(n.size(), kRecordNameCapacity - 1);
+        std::memcpy(name, n.data(), len);
+        name[len] = '\0';
     }
 
-    void emit_span(duration_us duration) {
-        std::ostringstream json;
-        json << R"({"name":")" << data_.name << R"(",)"
-             << R"("span_id":)" << data_.span_id << ","
-             << R"("parent_id":)" << data_.parent_id << ","
-             << R"("duration_us":)" << duration.count() << ","
-             << R"("thread_id":")" << data_.thread_id << R"("})";
+    // After set_name: stores the error code and message behind the name's
+    // NUL, shortening the name if it leaves no room for the code.
+    void set_error(int32_t code, std::string_view message) {
+        std::size_t at = std::min(std::strlen(name),
+                                  kRecordNameCapacity - sizeof(code) - 2);
+        name[at++] = '\0';
+        std::memcpy(name + at, &code, sizeof(code));
+        at += sizeof(code);
+        std::size_t len = std::min(message.size(), kRecordNameCapacity - 1 - at);
+        std::memcpy(name + at, message.data(), len);
+        name[at + len] = '\0';
+        flags |= kSpanError;
+    }
 
-        TraceBackend::instance().write_span(json.str());
+    int32_t error_code() const {
+        int32_t code = 0;
+        if (flags & kSpanError) {
+            std::memcpy(&code, name + std::strlen(name) + 1, sizeof(code));
+        }
+        return code;
     }
 
-    SpanData data_;
+    std::string_view error_message() const {
+        if (!(flags & kSpanError)) {
+            return {};
+        }
+        return name + std::strlen(name) + 1 + sizeof(int32_t);
+    }
 };
 
+static_assert(std::is_trivially_copyable<SpanRecord>::value,
+              "SpanRecord is copied into ring slots with memcpy");
+static_assert(sizeof(SpanRecord) % 8 == 0,
+              "rseq commit copies records a quadword at a time");
+
+namespace detail {
+// Names, messages and frames are stored raw everywhere; each record
+// formatter escapes them with this as it writes them.
+inline void write_json_escaped(std::ostream& out, std::string_view text) {
+    for (char c : text) {
+        switch (c) {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf]
+                    << "0123456789abcdef"[c & 0xf];
+            } else {
+                out << c;
+            }
+        }
+    }
+}
+} // namespace detail
+
+inline void format_span_json(std::ostream& out, std::string_view name,
+                             uint64_t span_id, uint64_t parent_id,
+                             int64_t duration_us, uint32_t thread_id,
+                             uint8_t flags = 0, int64_t budget_us = 0,
+                             int32_t error_code = 0, std::string_view error_msg = {}) {
+    out << R"({"name":")";
+    detail::write_json_escaped(out, name);
+    out << R"(",)"
+        << R"("span_id":)" << span_id << ","
+        << R"("parent_id":)" << parent_id << ","
+        << R"("duration_us":)" << duration_us << ","
+        << R"("thread_id":)" << thread_id;
+    if (flags & kSpanOverBudget) {
+        out << R"(,"over_budget":true,"budget_us":)" << budget_us;
+    }
+    if (flags & kSpanError) {
+        out << R"(,"error":true,"error_code":)" << error_code << R"(,"error_msg":")";
+        detail::write_json_escaped(out, error_msg);
+        out << '"';
+    }
+    out << '}';
+}
+
+// `frames` are already symbolized, leaf first.
+inline void format_sample_json(std::ostream& out, uint64_t span_id,
+                               uint32_t thread_id,
+                               const std::vector<std::string>& frames) {
+    out << R"({"type":"sample","span_id":)" << span_id << ","
+        << R"("thread_id":)" << thread_id << R"(,"stack":[)";
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        out << (i ? ",\"" : "\"");
+        detail::write_json_escaped(out, frames[i]);
+        out << '"';
+    }
+    out << "]}";
+}
+
 // ============================================================================
-// Helpers
+// Log records - TT_LOG arguments captured raw, formatted by the writer
 // ============================================================================
+//
+// The producer only copies each argument's bytes after a one-byte type tag
+// (strings with a length byte, truncated to what fits); the format string
+// stays in the static LogSite. The writer walks the "{}" placeholders and
+// prints the decoded arguments in order. "{{" and "}}" are literal braces.
 
-inline void set_trace_output(const std::string& path) {
-    TraceBackend::instance().set_output_file(path);
-}
+struct LogSite {
+    const char* format;
+    const char* file;
+    int line;
+    Level level;
+};
 
-inline void flush_traces() {
-    TraceBackend::instance().flush();
+constexpr const char* level_name(Level level) {
+    switch (level) {
+    case Level::trace:
+        return "trace";
+    case Level::debug:
+        return "debug";
+    case Level::info:
+        return "info";
+    case Level::warn:
+        return "warn";
+    case Level::error:
+        return "error";
+    }
+    return "?";
 }
 
-// Optional: scoped macro for convenience
-#define TRACE_SPAN(name) tinytrace::TraceSpan _trace_span_##__LINE__(name)
+namespace detail {
+
+enum class ArgType : uint8_t { end, i64, u64, f64, boolean, str, ptr };
+
+class ArgEncoder {
+public:
+    ArgEncoder(char* buf, std::size_t capacity) : buf_(buf), capacity_(capacity) {}
+
+    template <typename T>
+    void add(const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            uint8_t b = value ? 1 : 0;
+            put(ArgType::boolean, &b, 1);
+        } else if constexpr (std::is_same_v<T, char>) {
+            put_str(std::string_view(&value, 1));
+        } else if constexpr (std::is_enum_v<T>) {
+            add(static_cast<std::underlying_type_t<T>>(value));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            int64_t v = static_cast<int64_t>(value);
+            put(ArgType::i64, &v, sizeof(v));
+        } else if constexpr (std::is_integral_v<T>) {
+            uint64_t v = static_cast<uint64_t>(value);
+            put(ArgType::u64, &v, sizeof(v));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            double v = static_cast<double>(value);
+            put(ArgType::f64, &v, sizeof(v));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            put_str(std::string_view(value));
+        } else if constexpr (std::is_pointer_v<T>) {
+            uint64_t v = reinterpret_cast<uint64_t>(value);
+            put(ArgType::ptr, &v, sizeof(v));
+        } else {
+            static_assert(sizeof(T) == 0, "unsupported TT_LOG or TRACE_SPAN_FMT argument type");
+        }
+    }
+
+    // Terminates the list; returns false if anything was cut.
+    bool finish() {
+        if (used_ < capacity_) {
+            buf_[used_] = static_cast<char>(ArgType::end);
+        }
+        return !truncated_;
+    }
+
+private:
+    void put(ArgType type, const void* data, std::size_t size) {
+        if (truncated_ || used_ + 1 + size > capacity_) {
+            truncated_ = true;
+            return;
+        }
+        buf_[used_++] = static_cast<char>(type);
+        std::memcpy(buf_ + used_, data, size);
+        used_ += size;
+    }
+
+    void put_str(std::string_view str) {
+        if (truncated_ || used_ + 2 > capacity_) {
+            truncated_ = true;
+            return;
+        }
+        std::size_t room = std::min<std::size_t>(capacity_ - used_ - 2, 255);
+        std::size_t len = std::min(str.size(), room);
+        truncated_ = len < str.size();
+        buf_[used_++] = static_cast<char>(ArgType::str);
+        buf_[used_++] = static_cast<char>(static_cast<uint8_t>(len));
+        std::memcpy(buf_ + used_, str.data(), len);
+        used_ += len;
+    }
+
+    char* buf_;
+    std::size_t capacity_;
+    std::size_t used_ = 0;
+    bool truncated_ = false;
+};
+
+// Prints the next encoded argument at `pos`; false once they run out.
+inline bool print_next_arg(std::ostream& out, const char* buf, std::size_t capacity,
+                           std::size_t& pos) {
+    if (pos >= capacity) {
+        return false;
+    }
+    auto type = static_cast<ArgType>(buf[pos++]);
+    auto take = [&](void* dst, std::size_t size) {
+        if (pos + size > capacity) {
+            return false;
+        }
+        std::memcpy(dst, buf + pos, size);
+        pos += size;
+        return true;
+    };
+    switch (type) {
+    case ArgType::i64: {
+        int64_t v;
+        if (!take(&v, sizeof(v))) {
+            return false;
+        }
+        out << v;
+        return true;
+    }
+    case ArgType::u64: {
+        uint64_t v;
+        if (!take(&v, sizeof(v))) {
+            return false;
+        }
+        out << v;
+        return true;
+    }
+    case ArgType::f64: {
+        double v;
+        if (!take(&v, sizeof(v))) {
+            return false;
+        }
+        out << v;
+        return true;
+    }
+    case ArgType::boolean: {
+        uint8_t v;
+        if (!take(&v, 1)) {
+            return false;
+        }
+        out << (v ? "true" : "false");
+        return true;
+    }
+    case ArgType::ptr: {
+        uint64_t v;
+        if (!take(&v, sizeof(v))) {
+            return false;
+        }
+        out << "0x" << std::hex << v << std::dec;
+        return true;
+    }
+    case ArgType::str: {
+        uint8_t len;
+        if (!take(&len, 1) || pos + len > capacity) {
+            return false;
+        }
+        out.write(buf + pos, len);
+        pos += len;
+        return true;
+    }
+    case ArgType::end:
+        break;
+    }
+    return false;
+}
+
+// Expands `format` with the arguments encoded in `buf`. Placeholders
+// without an argument (cut off or never passed) print as "{?}".
+inline void format_args(std::ostream& out, std::string_view format, const char* buf,
+                        std::size_t capacity) {
+    std::size_t pos = 0;
+    for (std::size_t i = 0; i < format.size(); ++i) {
+        char c = format[i];
+        if ((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c) {
+            out << c;
+            ++i;
+        } else if (c == '{' && i + 1 < format.size() && format[i + 1] == '}') {
+            if (!print_next_arg(out, buf, capacity, pos)) {
+                out << "{?}";
+                pos = capacity;
+            }
+            ++i;
+        } else {
+            out << c;
+        }
+    }
+}
+
+// A TRACE_SPAN_FMT span's arguments, encoded when the span opens (if its
+// site is enabled) and expanded into its name only on export.
+struct SpanArgs {
+    const char* format = nullptr;
+    bool encoded = false;
+    bool truncated = false;
+    char bytes[kRecordNameCapacity];
+
+    template <typename... Args>
+    void encode(const Args&... args) {
+        ArgEncoder encoder(bytes, sizeof(bytes));
+        (encoder.add(args), ...);
+        truncated = !encoder.finish();
+        encoded = true;
+    }
+};
+
+// The exported name of a formatted span. Raw like every other name; the
+// record formatters escape it.
+inline std::string expand_span_name(const char* format, const char* args,
+                                    bool truncated) {
+    std::ostringstream name;
+    format_args(name, format, args, kRecordNameCapacity);
+    if (truncated) {
+        name << "...";
+    }
+    return name.str();
+}
+} // namespace detail
+
+// `rec.duration_ns` carries the log timestamp (clock_type, ns).
+inline void format_log_json(std::ostream& out, const SpanRecord& rec) {
+    const auto* site = reinterpret_cast<const LogSite*>(rec.address);
+    std::ostringstream message;
+    detail::format_args(message, site->format, rec.args, kRecordNameCapacity);
+    if (rec.flags & kArgsTruncated) {
+        message << "...";
+    }
+    out << R"({"type":"log","level":")" << level_name(site->level) << R"(",)"
+        << R"("span_id":)" << rec.span_id << ","
+        << R"("ts_ns":)" << rec.duration_ns << ","
+        << R"("thread_id":)" << rec.thread_id << ","
+        << R"("file":")";
+    detail::write_json_escaped(out, site->file);
+    out << R"(","line":)" << site->line << ","
+        << R"("msg":")";
+    detail::write_json_escaped(out, message.str());
+    out << "\"}";
+}
+
+// `rec.duration_ns` carries the event timestamp; `rec.args` holds the
+// attributes as alternating keys and values.
+inline void format_event_json(std::ostream& out, const SpanRecord& rec) {
+    out << R"({"type":"event","name":")";
+    detail::write_json_escaped(out, reinterpret_cast<const char*>(rec.address));
+    out << R"(","span_id":)" << rec.span_id << ","
+        << R"("ts_ns":)" << rec.duration_ns << ","
+        << R"("thread_id":)" << rec.thread_id << R"(,"attrs":{)";
+    std::size_t pos = 0;
+    std::ostringstream key;
+    for (bool first = true; detail::print_next_arg(key, rec.args, kRecordNameCapacity, pos);
+         first = false) {
+        out << (first ? "\"" : ",\"");
+        detail::write_json_escaped(out, key.str());
+        out << "\":";
+        key.str("");
+        auto type = pos < kRecordNameCapacity ? static_cast<detail::ArgType>(rec.args[pos])
+                                              : detail::ArgType::end;
+        std::ostringstream value;
+        if (!detail::print_next_arg(value, rec.args, kRecordNameCapacity, pos)) {
+            out << "null";
+            break;
+        }
+        if (type == detail::ArgType::str || type == detail::ArgType::ptr) {
+            out << '"';
+            detail::write_json_escaped(out, value.str());
+            out << '"';
+        } else {
+            out << value.str();
+        }
+    }
+    out << '}';
+    if (rec.flags & kArgsTruncated) {
+        out << R"(,"attrs_truncated":true)";
+    }
+    out << '}';
+}
+
+// `rec.duration_ns` carries the timestamp of this end of the flow.
+inline void format_flow_json(std::ostream& out, const SpanRecord& rec) {
+    bool end = rec.flags & kFlowEnd;
+    out << R"({"type":"flow","phase":")" << (end ? "end" : "begin") << R"(","name":")";
+    detail::write_json_escaped(out, reinterpret_cast<const char*>(rec.address));
+    out << R"(","flow_id":)" << rec.parent_id << ","
+        << R"("span_id":)" << rec.span_id << ","
+        << R"("ts_ns":)" << rec.duration_ns << ","
+        << R"("thread_id":)" << rec.thread_id;
+    if (end) {
+        out << R"(,"wait_us":)"
+            << (rec.duration_ns - static_cast<int64_t>(rec.frames[0])) / 1000;
+    }
+    out << '}';
+}
+
+// `rec.duration_ns` carries the timestamp of the value. Values are written
+// with enough digits to read back exactly; NaN and infinities, which JSON
+// cannot represent, are written as null.
+inline void format_counter_json(std::ostream& out, const SpanRecord& rec) {
+    double value;
+    std::memcpy(&value, &rec.frames[0], sizeof(value));
+    out << R"({"type":"counter","name":")";
+    detail::write_json_escaped(out, reinterpret_cast<const char*>(rec.address));
+    out << R"(","ts_ns":)" << rec.duration_ns << R"(,"value":)";
+    if (std::isfinite(value)) {
+        std::streamsize precision =
+            out.precision(std::numeric_limits<double>::max_digits10);
+        out << value;
+        out.precision(precision);
+    } else {
+        out << "null";
+    }
+    out << R"(,"thread_id":)" << rec.thread_id << '}';
+}
+
+inline void format_thread_json(std::ostream& out, const ThreadInfo& info) {
+    out << R"({"type":"thread","thread_id":)" << info.index << ","
+        << R"("tid":)" << info.tid << R"(,"name":")";
+    detail::write_json_escaped(out, info.name);
+    out << "\"}";
+}
+
+// ============================================================================
+// PerCpuBuffers - one SPSC-style ring per CPU, single consumer
+// ============================================================================
+//
+// Producers append to the ring of the CPU they are running on, so memory and
+// drain cost scale with core count instead of thread count. With rseq the
+// slot copy and head bump form a restartable sequence: if the thread is
+// preempted or migrated mid-copy the kernel aborts it and we retry, so no
+// lock or atomic RMW is needed. Without rseq we fall back to sched_getcpu()
+// plus a per-CPU spinlock, which is almost never contended since only
+// threads sharing a CPU can collide.
+//
+// The choice is made once per process: a locked writer can migrate mid-copy
+// and race an rseq writer on the ring it picked, so the two never share a
+// ring. Threads without an rseq registration of their own (cpu_id < 0) use
+// one extra, locked ring that no rseq writer touches.
+
+namespace detail {
+
+#if TINYTRACE_HAVE_RSEQ
+inline bool rseq_available() {
+    return __rseq_size > 0;
+}
+
+inline int32_t rseq_cpu_id() {
+    int32_t cpu;
+    __asm__ __volatile__("movl %%fs:4(%1), %0"
+                         : "=r"(cpu)
+                         : "r"(__rseq_offset));
+    return cpu;
+}
+
+// Copy `len` bytes (a multiple of 8) to `dst` and store `expect + 1` into
+// `*head`, provided we are still on `cpu` and `*head == expect`.
+// Returns 0 on commit, 1 if the sequence was aborted, 2 if head moved.
+inline int rseq_copy_and_commit(int32_t cpu, uint64_t* head, uint64_t expect,
+                                void* dst, const void* src, std::size_t len) {
+    int ret;
+    __asm__ __volatile__(
+        ".pushsection __rseq_cs, \"aw?\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"
+        ".quad 1f, (2f - 1f), 4f\n\t"
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %%fs:8(%[rseq_off])\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %%fs:4(%[rseq_off])\n\t"
+        "jnz 4f\n\t"
+        "cmpq %[expect], %[head]\n\t"
+        "jnz 5f\n\t"
+        "6:\n\t"
+        "movq (%[src]), %%rax\n\t"
+        "movq %%rax, (%[dst])\n\t"
+        "addq $8, %[src]\n\t"
+        "addq $8, %[dst]\n\t"
+        "subq $8, %[len]\n\t"
+        "jnz 6b\n\t"
+        "movq %[newv], %[head]\n\t"
+        "2:\n\t"
+        "xorl %[ret], %[ret]\n\t"
+        "jmp 7f\n\t"
+        ".pushsection __rseq_failure, \"ax?\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t" // RSEQ_SIG, must precede the abort IP
+        "4:\n\t"
+        "movl $1, %[ret]\n\t"
+        "jmp 7f\n\t"
+        "5:\n\t"
+        "movl $2, %[ret]\n\t"
+        "jmp 7f\n\t"
+        ".popsection\n\t"
+        "7:\n\t"
+        : [ret] "=&r"(ret), [src] "+r"(src), [dst] "+r"(dst), [len] "+r"(len),
+          [head] "+m"(*head)
+        : [cpu] "r"(cpu), [rseq_off] "r"(__rseq_offset),
+          [expect] "r"(expect), [newv] "r"(expect + 1)
+        : "rax", "memory", "cc");
+    return ret;
+}
+#endif
+
+inline std::size_t round_up_pow2(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+#if defined(__linux__)
+inline void futex_wait(std::atomic<uint32_t>* word, uint32_t expected,
+                       std::chrono::nanoseconds timeout) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE,
+            expected, &ts, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE,
+            1, nullptr, nullptr, 0);
+}
+#endif
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+} // namespace detail
+
+class PerCpuBuffers {
+public:
+    explicit PerCpuBuffers(std::size_t capacity_per_cpu,
+                           std::size_t cpus = detect_cpu_count())
+        : cpus_(std::max<std::size_t>(cpus, 1)),
+          capacity_(detail::round_up_pow2(std::max<std::size_t>(capacity_per_cpu, 2))),
+          rings_(new Ring[cpus_ + 1]),
+          slots_(new SpanRecord[(cpus_ + 1) * capacity_]) {
+#if TINYTRACE_HAVE_RSEQ
+        use_rseq_ = detail::rseq_available();
+#endif
+    }
+
+    PerCpuBuffers(const PerCpuBuffers&) = delete;
+    PerCpuBuffers& operator=(const PerCpuBuffers&) = delete;
+
+    // Append to the current CPU's ring. Returns the ring's fill level after
+    // the append, or 0 (and counts a drop) when the ring is full; producers
+    // never block on the writer.
+    std::size_t push(const SpanRecord& rec) {
+#if TINYTRACE_HAVE_RSEQ
+        if (use_rseq_) {
+            return push_rseq(rec);
+        }
+#endif
+        return push_locked(rec, current_cpu() % cpus_);
+    }
+
+    // Single consumer: hand every committed record to `fn`, oldest first
+    // within each CPU. Returns the number of records drained.
+    template <typename F>
+    std::size_t drain(F&& fn) {
+        std::size_t total = 0;
+        for (std::size_t cpu = 0; cpu <= cpus_; ++cpu) {
+            Ring& ring = rings_[cpu];
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+            for (uint64_t i = tail; i != head; ++i) {
+                fn(slot(cpu, i));
+            }
+            ring.tail.store(head, std::memory_order_release);
+            total += static_cast<std::size_t>(head - tail);
+        }
+        return total;
+    }
+
+    // Forget everything, including locks held by threads that no longer
+    // exist. Only safe with no concurrent producers (e.g. in a fork child).
+    void reset() {
+        for (std::size_t cpu = 0; cpu <= cpus_; ++cpu) {
+            Ring& ring = rings_[cpu];
+            ring.head = 0;
+            ring.lock.clear(std::memory_order_relaxed);
+            ring.tail.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Records pushed but not drained yet, summed over CPUs.
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (std::size_t cpu = 0; cpu <= cpus_; ++cpu) {
+            total += fill(rings_[cpu], __atomic_load_n(&rings_[cpu].head, __ATOMIC_RELAXED));
+        }
+        return total;
+    }
+
+    std::size_t cpu_count() const { return cpus_; }
+    std::size_t capacity_per_cpu() const { return capacity_; }
+    bool uses_rseq() const { return use_rseq_; }
+
+    // Whether push() from this thread takes no lock: rseq is in use and
+    // registered for the thread. Safe to call from a signal handler.
+    bool push_lock_free() const {
+#if TINYTRACE_HAVE_RSEQ
+        return use_rseq_ && detail::rseq_cpu_id() >= 0;
+#else
+        return false;
+#endif
+    }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static std::size_t detect_cpu_count() {
+#if defined(__linux__)
+        long n = sysconf(_SC_NPROCESSORS_CONF);
+        if (n > 0) {
+            return static_cast<std::size_t>(n);
+        }
+#endif
+        unsigned n_hw = std::thread::hardware_concurrency();
+        return n_hw > 0 ? n_hw : 1;
+    }
+
+private:
+    struct Ring {
+        // Producer side; written by the rseq asm or under `lock`.
+        alignas(64) uint64_t head = 0;
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        // Consumer side, on its own cache line.
+        alignas(64) std::atomic<uint64_t> tail{0};
+    };
+
+    SpanRecord& slot(std::size_t cpu, uint64_t index) {
+        return slots_[cpu * capacity_ + (index & (capacity_ - 1))];
+    }
+
+    std::size_t fill(const Ring& ring, uint64_t head) const {
+        return static_cast<std::size_t>(
+            head - ring.tail.load(std::memory_order_acquire));
+    }
+
+    std::size_t drop() {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+#if TINYTRACE_HAVE_RSEQ
+    std::size_t push_rseq(const SpanRecord& rec) {
+        for (;;) {
+            int32_t cpu = detail::rseq_cpu_id();
+            if (cpu < 0) {
+                return push_locked(rec, cpus_);
+            }
+            std::size_t index = static_cast<std::size_t>(cpu) % cpus_;
+            Ring& ring = rings_[index];
+            uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+            std::size_t used = fill(ring, head);
+            if (used >= capacity_) {
+                return drop();
+            }
+            if (detail::rseq_copy_and_commit(cpu, &ring.head, head,
+                                             &slot(index, head), &rec,
+                                             sizeof(SpanRecord)) == 0) {
+                return used + 1;
+            }
+        }
+    }
+#endif
+
+    std::size_t push_locked(const SpanRecord& rec, std::size_t index) {
+        Ring& ring = rings_[index];
+        while (ring.lock.test_and_set(std::memory_order_acquire)) {
+            detail::cpu_relax();
+        }
+        uint64_t head = ring.head;
+        std::size_t used = fill(ring, head);
+        if (used < capacity_) {
+            slot(index, head) = rec;
+            __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+        }
+        ring.lock.clear(std::memory_order_release);
+        return used < capacity_ ? used + 1 : drop();
+    }
+
+    static std::size_t current_cpu() {
+#if defined(__linux__)
+        int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return static_cast<std::size_t>(cpu);
+        }
+#endif
+        return std::hash<std::thread::id>{}(std::this_thread::get_id());
+    }
+
+    std::size_t cpus_;
+    std::size_t capacity_;
+    std::unique_ptr<Ring[]> rings_; // one per CPU, then the rseq-less ring
+    std::unique_ptr<SpanRecord[]> slots_;
+    bool use_rseq_ = false;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// ============================================================================
+// MpscQueue - bounded lock-free multi-producer/single-consumer queue
+// ============================================================================
+//
+// Dmitry Vyukov's bounded queue: each cell carries a sequence number that
+// tells producers whether it is free and the consumer whether it is
+// published. Producers claim a position with one CAS on the shared tail;
+// the single consumer needs no RMW at all and drains in batches.
+
+class MpscQueue {
+public:
+    explicit MpscQueue(std::size_t capacity)
+        : capacity_(detail::round_up_pow2(std::max<std::size_t>(capacity, 2))),
+          cells_(new Cell[capacity_]) {
+        for (std::size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Forget everything, including cells claimed by threads that no longer
+    // exist. Only safe with no concurrent producers (e.g. in a fork child).
+    void reset() {
+        for (std::size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_ = 0;
+        consumed_.store(0, std::memory_order_relaxed);
+    }
+
+    // Returns the approximate queue depth after the push, or 0 (and counts
+    // a drop) when the queue is full.
+    std::size_t push(const SpanRecord& rec) {
+        uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & (capacity_ - 1)];
+            uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed)) {
+                    cell.record = rec;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return static_cast<std::size_t>(
+                        pos + 1 - consumed_.load(std::memory_order_relaxed));
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Single consumer: hand up to `max_batch` published records to `fn`.
+    template <typename F>
+    std::size_t drain(F&& fn, std::size_t max_batch = SIZE_MAX) {
+        std::size_t n = 0;
+        while (n < max_batch) {
+            Cell& cell = cells_[dequeue_pos_ & (capacity_ - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+                break;
+            }
+            fn(cell.record);
+            cell.sequence.store(dequeue_pos_ + capacity_, std::memory_order_release);
+            ++dequeue_pos_;
+            ++n;
+        }
+        consumed_.store(dequeue_pos_, std::memory_order_relaxed);
+        return n;
+    }
+
+    // Approximate: claimed positions not drained yet.
+    std::size_t size() const {
+        return static_cast<std::size_t>(enqueue_pos_.load(std::memory_order_relaxed) -
+                                        consumed_.load(std::memory_order_relaxed));
+    }
+
+    std::size_t capacity() const { return capacity_; }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> sequence{0};
+        SpanRecord record;
+    };
+
+    std::size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<uint64_t> enqueue_pos_{0};
+    alignas(64) uint64_t dequeue_pos_ = 0;
+    std::atomic<uint64_t> consumed_{0}; // dequeue_pos_ as seen by producers
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// ============================================================================
+// Buffering and writer options
+// ============================================================================
+
+enum class BufferMode {
+    direct,  // format and write under the backend mutex (default)
+    per_cpu, // append to per-CPU rings, drained by a background writer
+    mpsc,    // append to one shared lock-free queue, drained by the writer
+};
+
+constexpr std::size_t kDefaultBufferCapacity = 4096;
+constexpr std::chrono::milliseconds kWriterPollInterval{10};
+
+// How the background writer finds out there is work to drain.
+enum class WakeupStrategy {
+    poll,   // sleep poll_interval between drains (default)
+    spin,   // busy-poll the buffers; lowest latency, burns a core
+    notify, // sleep on a futex; the producer that first sees a buffer reach
+            // notify_threshold wakes it. poll_interval is the fallback timeout.
+};
+
+struct WriterOptions {
+    std::vector<int> cpu_affinity; // CPUs the writer may run on; empty = inherit
+    int nice = 0;                  // applied when non-zero and !sched_idle
+    bool sched_idle = false;       // run the writer under SCHED_IDLE
+    WakeupStrategy wakeup = WakeupStrategy::poll;
+    std::chrono::microseconds poll_interval = kWriterPollInterval;
+    std::size_t notify_threshold = kDefaultBufferCapacity / 4;
+};
+
+// ============================================================================
+// TraceConfig - runtime settings, published RCU-style
+// ============================================================================
+//
+// Settings come from defaults, then TINYTRACE_* environment variables (read
+// once at startup), then an optional "key = value" config file. Each change
+// builds a fresh immutable snapshot and publishes it with one atomic pointer
+// store, so spans read settings with a single acquire load and never lock.
+// Old snapshots are retired rather than freed: reloads are rare and this
+// avoids needing a grace period for readers still holding the old one.
+//
+// Keys (file / environment):
+//   output           / TINYTRACE_OUTPUT           file path, empty = stdout
+//   sample_rate      / TINYTRACE_SAMPLE_RATE      fraction of traces kept
+//   min_duration_ns  / TINYTRACE_MIN_DURATION_NS  drop shorter spans
+//   buffer_mode      / TINYTRACE_BUFFER_MODE      direct | per_cpu | mpsc
+//   buffer_capacity  / TINYTRACE_BUFFER_CAPACITY  records per buffer
+//   disabled_spans   / TINYTRACE_DISABLED_SPANS   comma-separated name globs
+//   category_mask    / TINYTRACE_CATEGORY_MASK    enabled category bits
+//   telemetry_interval_ms / TINYTRACE_TELEMETRY_INTERVAL_MS
+//                                                 tracer_stats records, 0 = off
+//   log_level        / TINYTRACE_LOG_LEVEL        least severe TT_LOG kept
+//                      TINYTRACE_CONFIG           config file to watch
+
+struct TraceConfig {
+    std::string output;
+    double sample_rate = 1.0;
+    int64_t min_duration_ns = 0;
+    BufferMode buffer_mode = BufferMode::direct;
+    std::size_t buffer_capacity = kDefaultBufferCapacity;
+    std::string disabled_spans;
+    uint64_t category_mask = ~0ULL;
+    int64_t telemetry_interval_ms = 0;
+    Level log_level = Level::info;
+};
+
+namespace detail {
+
+inline std::string_view trim(std::string_view s) {
+    const char* ws = " \t\r\n";
+    std::size_t begin = s.find_first_not_of(ws);
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(begin, s.find_last_not_of(ws) - begin + 1);
+}
+
+// Calls `fn` with each non-empty glob of a comma-separated list such as
+// TraceConfig::disabled_spans; stops early if `fn` returns true.
+template <typename F>
+bool any_glob(std::string_view list, F&& fn) {
+    while (!list.empty()) {
+        std::size_t comma = list.find(',');
+        std::string_view glob = trim(list.substr(0, comma));
+        if (!glob.empty() && fn(glob)) {
+            return true;
+        }
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return false;
+}
+
+} // namespace detail
+
+// Apply one setting; returns false for an unknown key or unparsable value
+// (the config is left unchanged in that case).
+inline bool apply_config_setting(TraceConfig& config, std::string_view key,
+                                 std::string_view value) {
+    key = detail::trim(key);
+    std::string v(detail::trim(value));
+    try {
+        if (key == "output") {
+            config.output = v;
+        } else if (key == "sample_rate") {
+            config.sample_rate = std::min(std::max(std::stod(v), 0.0), 1.0);
+        } else if (key == "min_duration_ns") {
+            config.min_duration_ns = std::stoll(v);
+        } else if (key == "buffer_mode") {
+            if (v == "direct") {
+                config.buffer_mode = BufferMode::direct;
+            } else if (v == "per_cpu") {
+                config.buffer_mode = BufferMode::per_cpu;
+            } else if (v == "mpsc") {
+                config.buffer_mode = BufferMode::mpsc;
+            } else {
+                return false;
+            }
+        } else if (key == "buffer_capacity") {
+            config.buffer_capacity = static_cast<std::size_t>(std::stoull(v));
+        } else if (key == "disabled_spans") {
+            config.disabled_spans = v;
+        } else if (key == "category_mask") {
+            config.category_mask = std::stoull(v, nullptr, 0);
+        } else if (key == "telemetry_interval_ms") {
+            config.telemetry_interval_ms = std::max<int64_t>(std::stoll(v), 0);
+        } else if (key == "log_level") {
+            bool known = false;
+            for (Level level : {Level::trace, Level::debug, Level::info, Level::warn,
+                                Level::error}) {
+                if (v == level_name(level)) {
+                    config.log_level = level;
+                    known = true;
+                }
+            }
+            if (!known) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+inline void apply_config_env(TraceConfig& config) {
+    static const char* const keys[] = {"output", "sample_rate", "min_duration_ns",
+                                       "buffer_mode", "buffer_capacity",
+                                       "disabled_spans", "category_mask",
+                                       "telemetry_interval_ms", "log_level"};
+    for (const char* key : keys) {
+        std::string var = "TINYTRACE_";
+        for (const char* c = key; *c; ++c) {
+            var += static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+        }
+        if (const char* value = std::getenv(var.c_str())) {
+            apply_config_setting(config, key, value);
+        }
+    }
+}
+
+// Blank lines and lines starting with '#' are ignored. Returns false if the
+// file cannot be read.
+inline bool apply_config_file(TraceConfig& config, const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view l = detail::trim(line);
+        if (l.empty() || l.front() == '#') {
+            continue;
+        }
+        std::size_t eq = l.find('=');
+        if (eq != std::string_view::npos) {
+            apply_config_setting(config, l.substr(0, eq), l.substr(eq + 1));
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// ConfigWatcher - reloads the config file on change (inotify) or SIGHUP
+// ============================================================================
+//
+// Watchers share one SIGHUP handler. The first to ask for it saves the
+// previous disposition and the last to stop puts it back; up to
+// kMaxSighupWatchers of them are woken per signal.
+
+class ConfigWatcher {
+public:
+    ConfigWatcher() = default;
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+    ~ConfigWatcher() { stop(); }
+
+    void start(const std::string& path, bool on_sighup, std::function<void()> reload) {
+        stop();
+        path_ = path;
+        on_sighup_ = on_sighup;
+        reload_ = std::move(reload);
+        restart();
+    }
+
+    // Start again with the last path and callback (used after fork()).
+    void restart() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (thread_.joinable() || !reload_ || pipe(wake_pipe_) != 0) {
+            return;
+        }
+        if (on_sighup_) {
+            SighupTargets& targets = sighup_targets();
+            std::lock_guard<std::mutex> lock(targets.mutex);
+            if (!sighup_user_ && targets.users++ == 0) {
+                struct sigaction sa {};
+                sa.sa_handler = &ConfigWatcher::on_sighup;
+                sigemptyset(&sa.sa_mask);
+                sa.sa_flags = SA_RESTART;
+                sigaction(SIGHUP, &sa, &targets.previous);
+            }
+            sighup_user_ = true;
+            for (std::size_t i = 0; i < kMaxSighupWatchers && sighup_slot_ < 0; ++i) {
+                int expected = -1;
+                if (targets.fds[i].compare_exchange_strong(expected, wake_pipe_[1])) {
+                    sighup_slot_ = static_cast<int>(i);
+                }
+            }
+        }
+#if defined(__linux__)
+        // Watch the directory: editors usually replace the file by rename.
+        // Set up before the thread starts so no change is missed.
+        std::string dir = ".";
+        std::size_t slash = path_.find_last_of('/');
+        if (slash != std::string::npos) {
+            dir = slash == 0 ? "/" : path_.substr(0, slash);
+        }
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ >= 0 &&
+            inotify_add_watch(inotify_fd_, dir.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+#endif
+        stop_.store(false, std::memory_order_relaxed);
+        thread_ = std::thread([this]() { run(); });
+#endif
+    }
+
+    // Stops watching and gives back the SIGHUP handler.
+    void stop() {
+        pause();
+#if defined(__unix__) || defined(__APPLE__)
+        if (sighup_user_) {
+            SighupTargets& targets = sighup_targets();
+            std::lock_guard<std::mutex> lock(targets.mutex);
+            if (--targets.users == 0) {
+                sigaction(SIGHUP, &targets.previous, nullptr);
+            }
+            sighup_user_ = false;
+        }
+#endif
+    }
+
+    // Stops the thread but keeps the SIGHUP handler for restart(), so a
+    // SIGHUP around fork() is missed rather than fatal.
+    void pause() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (!thread_.joinable()) {
+            return;
+        }
+        stop_.store(true, std::memory_order_release);
+        char c = 's';
+        (void)!write(wake_pipe_[1], &c, 1);
+        thread_.join();
+        if (sighup_slot_ >= 0) {
+            sighup_targets().fds[sighup_slot_].store(-1, std::memory_order_release);
+            sighup_slot_ = -1;
+        }
+        close(wake_pipe_[0]);
+        close(wake_pipe_[1]);
+#if defined(__linux__)
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+#endif
+#endif
+    }
+
+    bool running() const { return thread_.joinable(); }
+    const std::string& path() const { return path_; }
+
+private:
+#if defined(__unix__) || defined(__APPLE__)
+    static constexpr std::size_t kMaxSighupWatchers = 8;
+
+    struct SighupTargets {
+        std::mutex mutex;
+        int users = 0; // watchers holding the handler
+        struct sigaction previous {};
+        std::atomic<int> fds[kMaxSighupWatchers]; // wake pipes, -1 = free
+
+        SighupTargets() {
+            for (auto& fd : fds) {
+                fd.store(-1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Never freed: the handler may run during static destruction.
+    static SighupTargets& sighup_targets() {
+        static SighupTargets* targets = new SighupTargets();
+        return *targets;
+    }
+
+    // Async-signal-safe: just poke the watcher threads.
+    static void on_sighup(int) {
+        for (auto& slot : sighup_targets().fds) {
+            int fd = slot.load(std::memory_order_acquire);
+            if (fd >= 0) {
+                char c = 'h';
+                (void)!write(fd, &c, 1);
+            }
+        }
+    }
+
+    void run() {
+        struct pollfd fds[2];
+        int nfds = 1;
+        fds[0] = {wake_pipe_[0], POLLIN, 0};
+#if defined(__linux__)
+        std::string base = path_.substr(path_.find_last_of('/') + 1);
+        if (inotify_fd_ >= 0) {
+            fds[1] = {inotify_fd_, POLLIN, 0};
+            nfds = 2;
+        }
+#endif
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (poll(fds, nfds, -1) <= 0) {
+                continue;
+            }
+            bool reload = false;
+            if (fds[0].revents & POLLIN) {
+                char buf[64];
+                (void)!read(wake_pipe_[0], buf, sizeof(buf));
+                reload = true;
+            }
+#if defined(__linux__)
+            if (nfds == 2 && (fds[1].revents & POLLIN)) {
+                alignas(struct inotify_event) char buf[4096];
+                ssize_t len;
+                while ((len = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+                    for (char* p = buf; p < buf + len;) {
+                        auto* ev = reinterpret_cast<struct inotify_event*>(p);
+                        if (ev->len > 0 && base == ev->name) {
+                            reload = true;
+                        }
+                        p += sizeof(struct inotify_event) + ev->len;
+                    }
+                }
+            }
+#endif
+            if (reload && !stop_.load(std::memory_order_acquire)) {
+                reload_();
+            }
+        }
+    }
+
+    int wake_pipe_[2] = {-1, -1};
+    int inotify_fd_ = -1;
+    int sighup_slot_ = -1;     // index in sighup_targets().fds
+    bool sighup_user_ = false; // counted in sighup_targets().users
+#endif
+
+    std::string path_;
+    bool on_sighup_ = false;
+    std::function<void()> reload_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+};
+
+// ============================================================================
+// Self-telemetry - what the tracer itself costs
+// ============================================================================
+
+namespace detail {
+// A counter bumped on the span hot path. Threads are dealt stripes round
+// robin, each on its own cache line, so they rarely contend; reads sum
+// the stripes.
+class StripedCounter {
+public:
+    void add(uint64_t n = 1) {
+        stripes_[stripe()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const {
+        uint64_t total = 0;
+        for (const Stripe& s : stripes_) {
+            total += s.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    static constexpr std::size_t kStripes = 16;
+
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> value{0};
+    };
+
+    static std::size_t stripe() {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t mine = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+        return mine;
+    }
+
+    Stripe stripes_[kStripes];
+};
+} // namespace detail
+
+// Snapshot of the tracer's own counters, from tracer_metrics(). Counts are
+// totals since startup.
+struct TracerMetrics {
+    uint64_t spans_recorded = 0;    // handed to the backend for output
+    uint64_t spans_dropped = 0;     // lost to a full buffer
+    uint64_t spans_filtered = 0;    // closed but unsampled or below min_duration_ns
+    uint64_t bytes_written = 0;
+    uint64_t buffered = 0;          // records waiting for the writer now
+    uint64_t buffer_high_water = 0; // most records seen waiting in one buffer
+    int64_t writer_lag_ns = 0;      // longest a record could have waited, last drain
+    int64_t writer_lag_max_ns = 0;  // the same, worst drain so far
+    int64_t write_ns = 0;           // spent formatting and writing output
+    int64_t span_overhead_ns = 0;   // mean cost of one span's bookkeeping, sampled
+    uint64_t overhead_samples = 0;
+};
+
+inline void format_metrics_json(std::ostream& out, const TracerMetrics& m) {
+    out << R"({"type":"tracer_stats","spans_recorded":)" << m.spans_recorded
+        << R"(,"spans_dropped":)" << m.spans_dropped
+        << R"(,"spans_filtered":)" << m.spans_filtered
+        << R"(,"bytes_written":)" << m.bytes_written
+        << R"(,"buffered":)" << m.buffered
+        << R"(,"buffer_high_water":)" << m.buffer_high_water
+        << R"(,"writer_lag_us":)" << m.writer_lag_ns / 1000
+        << R"(,"writer_lag_max_us":)" << m.writer_lag_max_ns / 1000
+        << R"(,"write_us":)" << m.write_ns / 1000
+        << R"(,"span_overhead_ns":)" << m.span_overhead_ns << '}';
+}
+
+// ============================================================================
+// TraceBackend - handles output (stdout or file)
+// ============================================================================
+
+class TraceBackend {
+public:
+    static TraceBackend& instance() {
+        static TraceBackend backend;
+        return backend;
+    }
+
+    // Appends to `path`. A path that cannot be opened, such as "", writes
+    // to stdout again.
+    void set_output_file(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file_output_ = std::make_unique<std::ofstream>(path, std::ios::app);
+        use_file_ = file_output_ && file_output_->is_open();
+        if (use_file_) {
+            write_thread_header(*file_output_);
+        }
+    }
+
+    // The thread record for `info`: buffered like a span if possible, so
+    // it reaches the output ahead of the thread's first span.
+    void write_thread(const ThreadInfo& info) {
+        if (buffered()) {
+            SpanRecord rec;
+            rec.kind = RecordKind::thread;
+            rec.span_id = static_cast<uint64_t>(info.tid);
+            rec.parent_id = 0;
+            rec.duration_ns = 0;
+            rec.thread_id = info.index;
+            rec.address = 0;
+            rec.set_name(info.name);
+            if (submit(rec)) {
+                return;
+            }
+        }
+        std::ostringstream json;
+        format_thread_json(json, info);
+        write_span(json.str());
+    }
+
+    // Runtime category filter, kept outside the snapshot so checking it is
+    // a single relaxed load.
+    uint64_t category_mask() const {
+        return category_mask_.load(std::memory_order_relaxed);
+    }
+
+    // Runtime filters for a span opened by name on a standalone backend
+    // (see Tracer): its category mask and its own disabled_spans globs.
+    bool span_allowed(std::string_view name, Category category) const {
+        if (((category_mask() >> category.bit) & 1) == 0) {
+            return false;
+        }
+        const std::string& disabled = config().disabled_spans;
+        return global_ || disabled.empty() ||
+               !detail::any_glob(disabled, [name](std::string_view glob) {
+                   return detail::glob_match(glob, name);
+               });
+    }
+
+    void set_category_enabled(Category category, bool on) {
+        uint64_t bit = 1ULL << category.bit;
+        if (on) {
+            category_mask_.fetch_or(bit, std::memory_order_relaxed);
+        } else {
+            category_mask_.fetch_and(~bit, std::memory_order_relaxed);
+        }
+    }
+
+    // Current settings snapshot: one acquire load, never locks.
+    const TraceConfig& config() const {
+        return *config_.load(std::memory_order_acquire);
+    }
+
+    // The head-sampling rate in effect: the configured rate under the
+    // overhead governor's cap. The cap is kept outside the snapshot, like
+    // the category mask, so governing never publishes (and retires) a
+    // config and a reload cannot lift it.
+    double sample_rate() const {
+        return std::min(config().sample_rate,
+                        sample_rate_cap_.load(std::memory_order_relaxed));
+    }
+
+    void set_sample_rate_cap(double cap) {
+        sample_rate_cap_.store(cap, std::memory_order_relaxed);
+    }
+
+    // Publish a new snapshot and apply the settings that are not read on
+    // the hot path (output file, buffer mode) if they changed.
+    void update_config(const TraceConfig& next) {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        publish_config(next);
+    }
+
+    // Rebuild settings from the environment plus the watched file, if any.
+    void reload_config() {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        TraceConfig next;
+        apply_config_env(next);
+        if (!config_path_.empty()) {
+            apply_config_file(next, config_path_);
+        }
+        publish_config(next);
+    }
+
+    // Load `path` now and reload it whenever it changes on disk or, if
+    // `on_sighup`, when the process receives SIGHUP.
+    void watch_config_file(const std::string& path, bool on_sighup = true) {
+        {
+            std::lock_guard<std::mutex> lock(config_mutex_);
+            config_path_ = path;
+        }
+        reload_config();
+        watcher_.start(path, on_sighup, [this]() { reload_config(); });
+    }
+
+    // After fork() the child reopens output at `pattern` with every "{pid}"
+    // replaced by its pid. Empty (default) keeps writing to the inherited
+    // stream, interleaved with the parent.
+    void set_fork_output_pattern(const std::string& pattern) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fork_output_pattern_ = pattern;
+    }
+
+    void write_span(const std::string& json) {
+        int64_t start = detail::now_ns();
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostream& out = (use_file_ && file_output_)
+                                ? static_cast<std::ostream&>(*file_output_)
+                                : std::cout;
+        out << json << '\n';
+        bytes_written_.fetch_add(json.size() + 1, std::memory_order_relaxed);
+        write_telemetry_if_due(out);
+        out.flush();
+        write_ns_.fetch_add(detail::now_ns() - start, std::memory_order_relaxed);
+    }
+
+    // Counted by emit paths that write directly rather than submit().
+    void count_recorded() { recorded_.add(); }
+    void count_filtered(uint64_t n = 1) { filtered_.add(n); }
+
+    void record_overhead(int64_t ns) {
+        overhead_ns_.fetch_add(ns, std::memory_order_relaxed);
+        overhead_samples_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Lock-free, so it is safe from the writer and from alerting code.
+    TracerMetrics metrics() const {
+        TracerMetrics m;
+        const PerCpuBuffers* per_cpu = per_cpu_view_.load(std::memory_order_acquire);
+        const MpscQueue* mpsc = mpsc_view_.load(std::memory_order_acquire);
+        m.spans_recorded = recorded_.load();
+        m.spans_dropped = (per_cpu ? per_cpu->dropped() : 0) + (mpsc ? mpsc->dropped() : 0);
+        m.spans_filtered = filtered_.load();
+        m.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+        m.buffered = (per_cpu ? per_cpu->size() : 0) + (mpsc ? mpsc->size() : 0);
+        m.buffer_high_water = high_water_.load(std::memory_order_relaxed);
+        m.writer_lag_ns = writer_lag_ns_.load(std::memory_order_relaxed);
+        m.writer_lag_max_ns = writer_lag_max_ns_.load(std::memory_order_relaxed);
+        m.write_ns = write_ns_.load(std::memory_order_relaxed);
+        m.overhead_samples = overhead_samples_.load(std::memory_order_relaxed);
+        if (m.overhead_samples != 0) {
+            m.span_overhead_ns = overhead_ns_.load(std::memory_order_relaxed) /
+                                 static_cast<int64_t>(m.overhead_samples);
+        }
+        return m;
+    }
+
+    // Buffered modes hand records here; returns false if no buffer is
+    // active (caller should fall back to direct). Full buffers drop and
+    // count rather than block, so this still returns true.
+    bool submit(const SpanRecord& rec) {
+        return push_to(active_mode_.load(std::memory_order_acquire), rec);
+    }
+
+    // For signal handlers: only the lock-free paths qualify. The per-CPU
+    // fallback, and the locked ring of a thread without rseq, spin on a
+    // ring lock the interrupted thread may be holding.
+    bool submit_from_signal(const SpanRecord& rec) {
+        BufferMode mode = active_mode_.load(std::memory_order_acquire);
+        if (mode == BufferMode::per_cpu && !per_cpu_->push_lock_free()) {
+            return false;
+        }
+        return push_to(mode, rec);
+    }
+
+    bool buffered() const {
+        return active_mode_.load(std::memory_order_relaxed) != BufferMode::direct;
+    }
+
+    // `capacity` is per CPU for per_cpu and total for mpsc; it only applies
+    // the first time that mode's buffer is created.
+    void set_buffer_mode(BufferMode mode,
+                         std::size_t capacity = kDefaultBufferCapacity) {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        // Buffers are created once and never freed while the backend
+        // lives, so a producer racing a mode switch never sees a dangling
+        // buffer; the writer keeps draining both.
+        if (mode == BufferMode::per_cpu && !per_cpu_) {
+            per_cpu_ = std::make_unique<PerCpuBuffers>(capacity);
+            per_cpu_view_.store(per_cpu_.get(), std::memory_order_release);
+        } else if (mode == BufferMode::mpsc && !mpsc_) {
+            mpsc_ = std::make_unique<MpscQueue>(capacity);
+            mpsc_view_.store(mpsc_.get(), std::memory_order_release);
+        }
+        active_mode_.store(mode, std::memory_order_release);
+        if (mode == BufferMode::direct) {
+            stop_writer();
+            drain();
+        } else {
+            start_writer();
+        }
+    }
+
+    BufferMode buffer_mode() const {
+        return active_mode_.load(std::memory_order_relaxed);
+    }
+
+    // Takes effect immediately; a running writer is restarted with the new
+    // affinity, scheduling class and wakeup strategy.
+    void set_writer_options(const WriterOptions& options) {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        bool running = writer_.joinable();
+        stop_writer();
+        writer_options_ = options;
+        notify_threshold_.store(options.wakeup == WakeupStrategy::notify
+                                    ? std::max<std::size_t>(options.notify_threshold, 1)
+                                    : SIZE_MAX,
+                                std::memory_order_relaxed);
+        if (running) {
+            start_writer();
+        }
+    }
+
+    WriterOptions writer_options() const {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        return writer_options_;
+    }
+
+    // Turns SpanRecord::address into a name. Called only by the draining
+    // thread, so it may allocate, cache and read symbol tables; records
+    // with an address but no symbolizer are written as hex.
+    void set_symbolizer(std::function<std::string(uint64_t)> symbolizer) {
+        std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+        symbolizer_ = std::move(symbolizer);
+    }
+
+    uint64_t dropped_spans() const {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        return (per_cpu_ ? per_cpu_->dropped() : 0) + (mpsc_ ? mpsc_->dropped() : 0);
+    }
+
+    void flush() {
+        drain();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (use_file_ && file_output_) {
+            file_output_->flush();
+        } else {
+            std::cout.flush();
+        }
+    }
+
+    // A standalone backend (see Tracer): `config` as given, without the
+    // TINYTRACE_* environment or a config-file watcher, and its own
+    // output, buffers, writer and locks.
+    explicit TraceBackend(const TraceConfig& config) {
+        publish_config(config);
+        enlist();
+    }
+
+    TraceBackend(const TraceBackend&) = delete;
+    TraceBackend& operator=(const TraceBackend&) = delete;
+
+    ~TraceBackend() {
+#if defined(__unix__) || defined(__APPLE__)
+        {
+            LiveBackends& live = LiveBackends::instance();
+            std::lock_guard<std::mutex> lock(live.mutex);
+            live.backends.erase(std::find(live.backends.begin(), live.backends.end(), this));
+        }
+#endif
+        watcher_.stop();
+        stop_writer();
+        drain();
+    }
+
+    // Write `info` to every backend alive, so each output names the
+    // thread before its first span.
+    static void write_thread_everywhere(const ThreadInfo& info) {
+#if defined(__unix__) || defined(__APPLE__)
+        LiveBackends& live = LiveBackends::instance();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        for (TraceBackend* backend : live.backends) {
+            backend->write_thread(info);
+        }
+#else
+        instance().write_thread(info);
+#endif
+    }
+
+private:
+    TraceBackend() : global_(true) {
+        TraceConfig initial;
+        apply_config_env(initial);
+        const char* config_file = std::getenv("TINYTRACE_CONFIG");
+        if (config_file && *config_file) {
+            config_path_ = config_file;
+            apply_config_file(initial, config_path_);
+        }
+        publish_config(initial);
+        if (!config_path_.empty()) {
+            watcher_.start(config_path_, true, [this]() { reload_config(); });
+        }
+        enlist();
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    // Every constructed backend. Only locked when a backend comes or goes,
+    // a thread registers, and around fork(), never on the span path.
+    struct LiveBackends {
+        std::mutex mutex;
+        std::vector<TraceBackend*> backends;
+
+        // Leaked on purpose: the global backend unlists itself during
+        // static destruction.
+        static LiveBackends& instance() {
+            static LiveBackends* live = new LiveBackends();
+            return *live;
+        }
+    };
+
+    void enlist() {
+        {
+            LiveBackends& live = LiveBackends::instance();
+            std::lock_guard<std::mutex> lock(live.mutex);
+            live.backends.push_back(this);
+        }
+        static std::once_flag registered;
+        std::call_once(registered, []() {
+            pthread_atfork(&TraceBackend::on_fork_prepare,
+                           &TraceBackend::on_fork_parent,
+                           &TraceBackend::on_fork_child);
+        });
+    }
+
+    // fork() only clones the calling thread: a lock held elsewhere would
+    // stay locked forever in the child and the writer would be gone. So
+    // every backend stops its writer, drains, and holds its locks across
+    // the fork; both sides then release them and restart the writers, and
+    // the child also discards buffer state left behind by threads that did
+    // not survive.
+    static void on_fork_prepare() {
+        LiveBackends& live = LiveBackends::instance();
+        live.mutex.lock();
+        for (TraceBackend* self : live.backends) {
+            self->prepare_fork();
+        }
+        OpenSpanRegistry::instance().lock_for_fork();
+        ThreadRegistry::instance().lock_for_fork();
+    }
+
+    static void on_fork_parent() {
+        ThreadRegistry::instance().unlock_after_fork(false, detail::t_thread_index);
+        OpenSpanRegistry::instance().unlock_after_fork(false, detail::t_thread_index);
+        LiveBackends& live = LiveBackends::instance();
+        for (TraceBackend* self : live.backends) {
+            self->resume_after_fork(false);
+        }
+        live.mutex.unlock();
+    }
+
+    static void on_fork_child() {
+        ThreadRegistry::instance().unlock_after_fork(true, detail::t_thread_index);
+        OpenSpanRegistry::instance().unlock_after_fork(true, detail::t_thread_index);
+        LiveBackends& live = LiveBackends::instance();
+        for (TraceBackend* self : live.backends) {
+            self->resume_after_fork(true);
+        }
+        live.mutex.unlock();
+    }
+
+    void prepare_fork() {
+        watcher_was_running_ = watcher_.running();
+        watcher_.pause();
+        config_mutex_.lock();
+        control_mutex_.lock();
+        writer_was_running_ = writer_.joinable();
+        stop_writer();
+        drain();
+        drain_mutex_.lock();
+        mutex_.lock();
+        std::ostream& out = (use_file_ && file_output_)
+                                ? static_cast<std::ostream&>(*file_output_)
+                                : std::cout;
+        out.flush();
+    }
+
+    void resume_after_fork(bool child) {
+        if (child) {
+            if (per_cpu_) {
+                per_cpu_->reset();
+            }
+            if (mpsc_) {
+                mpsc_->reset();
+            }
+            writer_sleeping_.store(false, std::memory_order_relaxed);
+            if (!fork_output_pattern_.empty()) {
+                std::string path = fork_output_pattern_;
+                std::string pid = std::to_string(getpid());
+                for (std::size_t at = path.find("{pid}"); at != std::string::npos;
+                     at = path.find("{pid}", at + pid.size())) {
+                    path.replace(at, 5, pid);
+                }
+                file_output_ = std::make_unique<std::ofstream>(path, std::ios::app);
+                use_file_ = file_output_->is_open();
+                if (use_file_) {
+                    write_thread_header(*file_output_);
+                }
+            }
+        }
+        mutex_.unlock();
+        drain_mutex_.unlock();
+        // Restart eagerly so the child's first spans are drained at full
+        // speed instead of waiting for a lazy restart check.
+        if (writer_was_running_) {
+            start_writer();
+        }
+        control_mutex_.unlock();
+        config_mutex_.unlock();
+        if (watcher_was_running_) {
+            watcher_.restart();
+        }
+    }
+#else
+    void enlist() {}
+#endif
+
+    // Caller holds mutex_. A new file starts with every known thread.
+    void write_thread_header(std::ostream& out) {
+        for (const ThreadInfo& info : ThreadRegistry::instance().snapshot()) {
+            format_thread_json(out, info);
+            out << '\n';
+        }
+        out.flush();
+    }
+
+    // Caller holds config_mutex_ (or is the constructor).
+    void publish_config(const TraceConfig& next) {
+        const TraceConfig* prev = config_.load(std::memory_order_relaxed);
+        auto snapshot = std::make_unique<TraceConfig>(next);
+        config_.store(snapshot.get(), std::memory_order_release);
+        retired_configs_.push_back(std::move(snapshot));
+
+        if (!prev || prev->output != next.output) {
+            if (!next.output.empty()) {
+                set_output_file(next.output);
+            } else if (prev) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                file_output_.reset();
+                use_file_ = false;
+            }
+        }
+        if (!prev || prev->buffer_mode != next.buffer_mode) {
+            set_buffer_mode(next.buffer_mode, next.buffer_capacity);
+        }
+        if (!prev || prev->category_mask != next.category_mask) {
+            category_mask_.store(next.category_mask, std::memory_order_relaxed);
+        }
+        // Site rules are process-wide, so only the global backend owns
+        // them; a standalone one matches its globs in span_allowed().
+        if (global_ && (prev ? prev->disabled_spans != next.disabled_spans
+                             : !next.disabled_spans.empty())) {
+            SiteRegistry& sites = SiteRegistry::instance();
+            sites.set_enabled("*", true);
+            detail::any_glob(next.disabled_spans, [&sites](std::string_view glob) {
+                sites.set_enabled(glob, false);
+                return false;
+            });
+        }
+    }
+
+    // Move everything buffered so far to the output. Serialized so the
+    // rings only ever see one consumer (writer thread or a flushing caller).
+    std::size_t drain() {
+        std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+        int64_t start = detail::now_ns();
+        std::ostringstream batch;
+        std::string symbol;
+        std::vector<std::string> stack;
+        auto format = [this, &batch, &symbol, &stack](const SpanRecord& rec) {
+            if (rec.kind == RecordKind::sample) {
+                stack.clear();
+                for (std::size_t i = 0; i < rec.frame_count && i < kSampleMaxFrames; ++i) {
+                    stack.push_back(symbolize(rec.frames[i]));
+                }
+                format_sample_json(batch, rec.span_id, rec.thread_id, stack);
+                batch << '\n';
+                return;
+            }
+            if (rec.kind == RecordKind::log) {
+                format_log_json(batch, rec);
+                batch << '\n';
+                return;
+            }
+            if (rec.kind == RecordKind::event) {
+                format_event_json(batch, rec);
+                batch << '\n';
+                return;
+            }
+            if (rec.kind == RecordKind::flow) {
+                format_flow_json(batch, rec);
+                batch << '\n';
+                return;
+            }
+            if (rec.kind == RecordKind::counter) {
+                format_counter_json(batch, rec);
+                batch << '\n';
+                return;
+            }
+            if (rec.kind == RecordKind::thread) {
+                format_thread_json(batch, {rec.thread_id, static_cast<int64_t>(rec.span_id),
+                                           rec.name});
+                batch << '\n';
+                return;
+            }
+            std::string_view name = rec.name;
+            if (rec.flags & kSpanFormattedName) {
+                symbol = detail::expand_span_name(reinterpret_cast<const char*>(rec.address),
+                                                  rec.args, rec.flags & kArgsTruncated);
+                name = symbol;
+            } else if (rec.address != 0) {
+                symbol = symbolize(rec.address);
+                name = symbol;
+            }
+            format_span_json(batch, name, rec.span_id, rec.parent_id,
+                             rec.duration_ns / 1000, rec.thread_id, rec.flags,
+                             rec.budget_us, rec.error_code(), rec.error_message());
+            batch << '\n';
+        };
+        std::size_t n = 0;
+        if (per_cpu_) {
+            n += per_cpu_->drain(format);
+        }
+        if (mpsc_) {
+            n += mpsc_->drain(format);
+        }
+        // A record pushed just after the previous drain looked at the
+        // buffers has waited until now.
+        int64_t previous = last_drain_start_ns_;
+        last_drain_start_ns_ = start;
+        if (n == 0 && !telemetry_due(start)) {
+            return 0;
+        }
+        std::string text = batch.str();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::ostream& out = (use_file_ && file_output_)
+                                    ? static_cast<std::ostream&>(*file_output_)
+                                    : std::cout;
+            out << text;
+            write_telemetry_if_due(out);
+            out.flush();
+        }
+        int64_t end = detail::now_ns();
+        bytes_written_.fetch_add(text.size(), std::memory_order_relaxed);
+        write_ns_.fetch_add(end - start, std::memory_order_relaxed);
+        if (n != 0 && previous != 0) {
+            int64_t lag = end - previous;
+            writer_lag_ns_.store(lag, std::memory_order_relaxed);
+            if (lag > writer_lag_max_ns_.load(std::memory_order_relaxed)) {
+                writer_lag_max_ns_.store(lag, std::memory_order_relaxed);
+            }
+        }
+        return n;
+    }
+
+    // Lazily arms the first deadline, so records start one interval in.
+    bool telemetry_due(int64_t now) {
+        int64_t interval = config().telemetry_interval_ms * 1000000;
+        if (interval <= 0) {
+            return false;
+        }
+        int64_t next = next_telemetry_ns_.load(std::memory_order_relaxed);
+        if (next == 0) {
+            next_telemetry_ns_.compare_exchange_strong(next, now + interval,
+                                                       std::memory_order_relaxed);
+            return false;
+        }
+        return now >= next;
+    }
+
+    // Caller holds mutex_, which serializes moving the deadline on.
+    void write_telemetry_if_due(std::ostream& out) {
+        int64_t now = detail::now_ns();
+        if (!telemetry_due(now)) {
+            return;
+        }
+        next_telemetry_ns_.store(now + config().telemetry_interval_ms * 1000000,
+                                 std::memory_order_relaxed);
+        std::ostringstream json;
+        format_metrics_json(json, metrics());
+        json << '\n';
+        std::string text = json.str();
+        out << text;
+        bytes_written_.fetch_add(text.size(), std::memory_order_relaxed);
+    }
+
+    bool push_to(BufferMode mode, const SpanRecord& rec) {
+        std::size_t fill;
+        switch (mode) {
+        case BufferMode::per_cpu:
+            fill = per_cpu_->push(rec);
+            break;
+        case BufferMode::mpsc:
+            fill = mpsc_->push(rec);
+            break;
+        default:
+            return false;
+        }
+        recorded_.add();
+        if (fill > high_water_.load(std::memory_order_relaxed)) {
+            high_water_.store(fill, std::memory_order_relaxed);
+        }
+        // Only a producer that sees the buffer past the threshold while the
+        // writer is asleep pays for a wakeup; everyone else does two loads.
+        if (fill >= notify_threshold_.load(std::memory_order_relaxed) &&
+            writer_sleeping_.load(std::memory_order_relaxed) &&
+            writer_sleeping_.exchange(false, std::memory_order_acq_rel)) {
+            wake_writer();
+        }
+        return true;
+    }
+
+    // Caller holds drain_mutex_.
+    std::string symbolize(uint64_t address) const {
+        if (symbolizer_) {
+            return symbolizer_(address);
+        }
+        std::ostringstream hex;
+        hex << "0x" << std::hex << address;
+        return hex.str();
+    }
+
+    void start_writer() {
+        if (writer_.joinable()) {
+            return;
+        }
+        writer_stop_.store(false, std::memory_order_relaxed);
+        writer_ = std::thread([this, options = writer_options_]() {
+            apply_writer_attributes(options);
+            writer_loop(options);
+        });
+    }
+
+    void stop_writer() {
+        if (!writer_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            writer_stop_.store(true, std::memory_order_release);
+        }
+        writer_cv_.notify_one();
+        wake_writer();
+        writer_.join();
+    }
+
+    void wake_writer() {
+        wake_seq_.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+        detail::futex_wake(&wake_seq_);
+#else
+        writer_cv_.notify_one();
+#endif
+    }
+
+    void writer_loop(const WriterOptions& options) {
+        while (!writer_stop_.load(std::memory_order_acquire)) {
+            std::size_t n = drain();
+            switch (options.wakeup) {
+            case WakeupStrategy::spin:
+                if (n == 0) {
+                    detail::cpu_relax();
+                }
+                break;
+            case WakeupStrategy::notify:
+                wait_for_notify(options.poll_interval);
+                break;
+            case WakeupStrategy::poll: {
+                std::unique_lock<std::mutex> lock(writer_mutex_);
+                writer_cv_.wait_for(lock, options.poll_interval, [this]() {
+                    return writer_stop_.load(std::memory_order_relaxed);
+                });
+                break;
+            }
+            }
+        }
+    }
+
+    void wait_for_notify(std::chrono::microseconds timeout) {
+        uint32_t seq = wake_seq_.load(std::memory_order_acquire);
+        writer_sleeping_.store(true, std::memory_order_seq_cst);
+        if (!writer_stop_.load(std::memory_order_acquire)) {
+#if defined(__linux__)
+            detail::futex_wait(&wake_seq_, seq, timeout);
+#else
+            std::unique_lock<std::mutex> lock(writer_mutex_);
+            writer_cv_.wait_for(lock, timeout, [this, seq]() {
+                return writer_stop_.load(std::memory_order_relaxed) ||
+                       wake_seq_.load(std::memory_order_relaxed) != seq;
+            });
+#endif
+        }
+        writer_sleeping_.store(false, std::memory_order_relaxed);
+    }
+
+    // Best effort: a writer that cannot be pinned or demoted still drains.
+    static void apply_writer_attributes(const WriterOptions& options) {
+#if defined(__linux__)
+        if (!options.cpu_affinity.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : options.cpu_affinity) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                    CPU_SET(cpu, &set);
+                }
+            }
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        if (options.sched_idle) {
+            sched_param param{};
+            pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+        } else if (options.nice != 0) {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)),
+                        options.nice);
+        }
+#else
+        (void)options;
+#endif
+    }
+
+    std::mutex mutex_;
+    std::unique_ptr<std::ofstream> file_output_;
+    bool use_file_ = false;
+    std::string fork_output_pattern_;
+    bool writer_was_running_ = false;
+    bool watcher_was_running_ = false;
+
+    const bool global_ = false; // the instance() backend, which owns site rules
+    std::mutex config_mutex_;
+    std::atomic<const TraceConfig*> config_{nullptr};
+    std::atomic<uint64_t> category_mask_{~0ULL};
+    std::atomic<double> sample_rate_cap_{1.0};
+    std::vector<std::unique_ptr<TraceConfig>> retired_configs_;
+    std::string config_path_;
+    ConfigWatcher watcher_;
+
+    mutable std::mutex control_mutex_;
+    std::unique_ptr<PerCpuBuffers> per_cpu_;
+    std::unique_ptr<MpscQueue> mpsc_;
+    std::atomic<BufferMode> active_mode_{BufferMode::direct};
+
+    std::mutex drain_mutex_;
+    std::function<std::string(uint64_t)> symbolizer_;
+    std::thread writer_;
+    WriterOptions writer_options_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    std::atomic<bool> writer_stop_{false};
+
+    // Producer-visible wakeup state for WakeupStrategy::notify.
+    alignas(64) std::atomic<std::size_t> notify_threshold_{SIZE_MAX};
+    std::atomic<bool> writer_sleeping_{false};
+    std::atomic<uint32_t> wake_seq_{0};
+
+    // Self-telemetry; see metrics().
+    detail::StripedCounter recorded_;
+    detail::StripedCounter filtered_;
+    alignas(64) std::atomic<std::size_t> high_water_{0};
+    std::atomic<const PerCpuBuffers*> per_cpu_view_{nullptr};
+    std::atomic<const MpscQueue*> mpsc_view_{nullptr};
+    alignas(64) std::atomic<uint64_t> bytes_written_{0};
+    std::atomic<int64_t> write_ns_{0};
+    std::atomic<int64_t> writer_lag_ns_{0};
+    std::atomic<int64_t> writer_lag_max_ns_{0};
+    std::atomic<int64_t> next_telemetry_ns_{0};
+    std::atomic<int64_t> overhead_ns_{0};
+    std::atomic<uint64_t> overhead_samples_{0};
+    int64_t last_drain_start_ns_ = 0; // guarded by drain_mutex_
+};
+
+namespace detail {
+inline uint32_t register_thread_index() {
+    static std::atomic<uint32_t> next{1};
+    uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+    t_thread_index = index;
+    TraceBackend::instance(); // exists before any record is written
+    TraceBackend::write_thread_everywhere(ThreadRegistry::instance().add(index));
+    return index;
+}
+
+// A failed span's status, see TraceSpan::set_error.
+struct SpanError {
+    int32_t code = 0;
+    std::string message;
+};
+
+// Hand a finished span to `backend`: a record if a buffer is active,
+// otherwise a formatted line written straight away. A nonzero `budget`
+// flags the span as having overrun it.
+inline void emit_span(TraceBackend& backend, std::string_view name, uint64_t span_id,
+                      uint64_t parent_id, std::chrono::nanoseconds duration,
+                      uint32_t thread_id, std::chrono::nanoseconds budget = {},
+                      const SpanArgs* args = nullptr, const SpanError* error = nullptr) {
+    auto flags = static_cast<uint8_t>((budget.count() != 0 ? kSpanOverBudget : 0) |
+                                      (error ? kSpanError : 0));
+    // The error shares the name buffer, so a failed span is named up front.
+    std::string expanded;
+    bool formatted = args && args->encoded;
+    if (formatted && error) {
+        expanded = expand_span_name(args->format, args->bytes, args->truncated);
+        name = expanded;
+        formatted = false;
+    }
+    int64_t budget_us = std::chrono::duration_cast<duration_us>(budget).count();
+    if (backend.buffered()) {
+        SpanRecord rec;
+        rec.span_id = span_id;
+        rec.parent_id = parent_id;
+        rec.duration_ns = duration.count();
+        rec.thread_id = thread_id;
+        rec.address = 0;
+        rec.flags = flags;
+        rec.budget_us = static_cast<uint32_t>(
+            std::min<int64_t>(budget_us, std::numeric_limits<uint32_t>::max()));
+        if (formatted) {
+            rec.address = reinterpret_cast<uint64_t>(args->format);
+            rec.flags |= kSpanFormattedName | (args->truncated ? kArgsTruncated : 0);
+            std::memcpy(rec.args, args->bytes, sizeof(rec.args));
+        } else {
+            rec.set_name(name);
+        }
+        if (error) {
+            rec.set_error(error->code, error->message);
+        }
+        if (backend.submit(rec)) {
+            return;
+        }
+    }
+
+    if (formatted) {
+        expanded = expand_span_name(args->format, args->bytes, args->truncated);
+        name = expanded;
+    }
+    std::ostringstream json;
+    format_span_json(json, name, span_id, parent_id,
+                     std::chrono::duration_cast<duration_us>(duration).count(), thread_id,
+                     flags, budget_us, error ? error->code : 0,
+                     error ? std::string_view(error->message) : std::string_view());
+    backend.count_recorded();
+
+    backend.write_span(json.str());
+}
+
+// TT_LOG's slow half: `format` is already in the site.
+template <typename... Args>
+void log(const LogSite& site, const char* /*format*/, const Args&... args) {
+    TraceBackend& backend = TraceBackend::instance();
+    if (site.level < backend.config().log_level) {
+        return;
+    }
+    TraceContext& ctx = TraceContext::instance();
+    SpanRecord rec;
+    rec.kind = RecordKind::log;
+    rec.span_id = ctx.current_span_id();
+    rec.parent_id = 0;
+    rec.duration_ns = now_ns();
+    rec.thread_id = ctx.thread_index();
+    rec.address = reinterpret_cast<uint64_t>(&site);
+    ArgEncoder encoder(rec.args, kRecordNameCapacity);
+    (encoder.add(args), ...);
+    if (!encoder.finish()) {
+        rec.flags |= kArgsTruncated;
+    }
+    if (backend.buffered() && backend.submit(rec)) {
+        return;
+    }
+    std::ostringstream json;
+    format_log_json(json, rec);
+    backend.write_span(json.str());
+}
+
+// TraceSpan::event's slow half: one record, no span ID or context push.
+template <typename... Attrs>
+void emit_event(TraceBackend& backend, const char* name, uint64_t span_id,
+                const Attrs&... attrs) {
+    SpanRecord rec;
+    rec.kind = RecordKind::event;
+    rec.span_id = span_id;
+    rec.parent_id = 0;
+    rec.duration_ns = now_ns();
+    rec.thread_id = thread_index();
+    rec.address = reinterpret_cast<uint64_t>(name);
+    ArgEncoder encoder(rec.args, kRecordNameCapacity);
+    (encoder.add(attrs), ...);
+    if (!encoder.finish()) {
+        rec.flags |= kArgsTruncated;
+    }
+    if (backend.buffered() && backend.submit(rec)) {
+        return;
+    }
+    std::ostringstream json;
+    format_event_json(json, rec);
+    backend.write_span(json.str());
+}
+
+// One end of a flow, tagged with the span open on this thread.
+inline void emit_flow(const char* name, uint64_t flow_id, int64_t ts_ns,
+                      int64_t begin_ns, bool end) {
+    TraceContext& ctx = TraceContext::instance();
+    SpanRecord rec;
+    rec.kind = RecordKind::flow;
+    rec.span_id = ctx.current_span_id();
+    rec.parent_id = flow_id;
+    rec.duration_ns = ts_ns;
+    rec.thread_id = ctx.thread_index();
+    rec.address = reinterpret_cast<uint64_t>(name);
+    rec.flags = end ? kFlowEnd : 0;
+    rec.frames[0] = static_cast<uint64_t>(begin_ns);
+    TraceBackend& backend = TraceBackend::instance();
+    if (backend.buffered() && backend.submit(rec)) {
+        return;
+    }
+    std::ostringstream json;
+    format_flow_json(json, rec);
+    backend.write_span(json.str());
+}
+
+inline void emit_counter(const char* name, double value) {
+    SpanRecord rec;
+    rec.kind = RecordKind::counter;
+    rec.span_id = 0;
+    rec.parent_id = 0;
+    rec.duration_ns = now_ns();
+    rec.thread_id = thread_index();
+    rec.address = reinterpret_cast<uint64_t>(name);
+    std::memcpy(&rec.frames[0], &value, sizeof(value));
+    TraceBackend& backend = TraceBackend::instance();
+    if (backend.buffered() && backend.submit(rec)) {
+        return;
+    }
+    std::ostringstream json;
+    format_counter_json(json, rec);
+    backend.write_span(json.str());
+}
+
+// A span sink's emit, with emit_span's parameters (see BasicTraceSpan).
+using SpanSinkFn = void (*)(TraceBackend&, std::string_view, uint64_t, uint64_t,
+                            std::chrono::nanoseconds, uint32_t, std::chrono::nanoseconds,
+                            const SpanArgs*, const SpanError*);
+
+// A closed span held back in case an enclosing budgeted span overruns.
+struct CapturedSpan {
+    std::string name;
+    uint64_t span_id;
+    uint64_t parent_id;
+    std::chrono::nanoseconds duration;
+    uint32_t thread_id;
+    TraceBackend* backend;
+    SpanSinkFn sink;
+};
+
+// Per thread: while an unsampled span with a budget is open, its unsampled
+// descendants are captured here instead of dropped. The outermost such
+// span clears them if everything stayed within budget.
+struct BudgetCapture {
+    static constexpr std::size_t kMaxSpans = 4096; // beyond this, drop
+
+    std::vector<CapturedSpan> spans;
+    uint32_t open = 0; // unsampled budgeted spans open on this thread
+};
+
+inline BudgetCapture& budget_capture() {
+    thread_local BudgetCapture capture;
+    return capture;
+}
+} // namespace detail
+
+// ============================================================================
+// Latency budgets - per-name violation counters
+// ============================================================================
+
+struct BudgetViolationStats {
+    std::string name;
+    uint64_t violations = 0;
+    int64_t worst_overrun_ns = 0;
+};
+
+// Only touched when a span overruns, so a plain map under a mutex will do.
+class BudgetRegistry {
+public:
+    static BudgetRegistry& instance() {
+        static BudgetRegistry registry;
+        return registry;
+    }
+
+    void record(std::string_view name, int64_t overrun_ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        BudgetViolationStats& stats = stats_[std::string(name)];
+        ++stats.violations;
+        stats.worst_overrun_ns = std::max(stats.worst_overrun_ns, overrun_ns);
+    }
+
+    std::vector<BudgetViolationStats> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<BudgetViolationStats> out;
+        for (const auto& [name, stats] : stats_) {
+            out.push_back(stats);
+            out.back().name = name;
+        }
+        return out;
+    }
+
+private:
+    BudgetRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, BudgetViolationStats> stats_;
+};
+
+struct SpanErrorStats {
+    std::string name;
+    uint64_t errors = 0;     // every failed span, including exceptions
+    uint64_t exceptions = 0; // closed by an exception unwinding through it
+};
+
+// Like BudgetRegistry, only touched by failed spans.
+class ErrorRegistry {
+public:
+    static ErrorRegistry& instance() {
+        static ErrorRegistry registry;
+        return registry;
+    }
+
+    void record(std::string_view name, bool exception) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SpanErrorStats& stats = stats_[std::string(name)];
+        ++stats.errors;
+        stats.exceptions += exception ? 1 : 0;
+    }
+
+    std::vector<SpanErrorStats> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<SpanErrorStats> out;
+        for (const auto& [name, stats] : stats_) {
+            out.push_back(stats);
+            out.back().name = name;
+        }
+        return out;
+    }
+
+private:
+    ErrorRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, SpanErrorStats> stats_;
+};
+
+// ============================================================================
+// Tracer - an independent tracer instance
+// ============================================================================
+//
+// A library or tenant that wants its traces kept apart creates its own
+// Tracer: it owns a TraceBackend with its own config snapshot, output,
+// buffers, writer thread, metrics and locks, so spans on one Tracer never
+// contend with another's. Spans join one with TraceSpan(tracer, name):
+//   tinytrace::Tracer tracer;
+//   tracer.set_output("storage.jsonl");
+//   { tinytrace::TraceSpan span(tracer, "compact"); }
+// Tracer::global() is the instance behind TRACE_SPAN and the free
+// functions. Still process-wide: span IDs, each thread's span stack (a
+// span's parent is whatever span is open on its thread, whichever tracer
+// it belongs to), thread indices, and the site, budget and error
+// registries. A Tracer's category_mask and disabled_spans only filter
+// its own spans, by name as each opens; TRACE_SPAN sites follow the
+// global tracer. A Tracer must outlive its spans.
+
+class Tracer {
+public:
+    explicit Tracer(const TraceConfig& config = TraceConfig{})
+        : owned_(std::make_unique<TraceBackend>(config)), backend_(owned_.get()) {}
+
+    static Tracer& global() {
+        static Tracer tracer(TraceBackend::instance());
+        return tracer;
+    }
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Change this tracer's settings, like tinytrace::configure.
+    template <typename F>
+    void configure(F&& mutate) {
+        TraceConfig next = backend_->config();
+        mutate(next);
+        backend_->update_config(next);
+    }
+
+    const TraceConfig& config() const { return backend_->config(); }
+
+    void set_output(const std::string& path) { backend_->set_output_file(path); }
+
+    void set_buffer_mode(BufferMode mode,
+                         std::size_t capacity = kDefaultBufferCapacity) {
+        backend_->set_buffer_mode(mode, capacity);
+    }
+
+    void flush() { backend_->flush(); }
+
+    TracerMetrics metrics() const { return backend_->metrics(); }
+
+    TraceBackend& backend() { return *backend_; }
+
+private:
+    explicit Tracer(TraceBackend& backend) : backend_(&backend) {}
+
+    std::unique_ptr<TraceBackend> owned_; // null for the global tracer
+    TraceBackend* backend_;
+};
+
+// ============================================================================
+// TraceSpan - RAII span for measuring duration
+// ============================================================================
+//
+// TraceSpan is BasicTraceSpan with the default policies. Policies are
+// chosen at compile time, so the open/close path makes no indirect calls
+// and can be inlined whole for a given set:
+//   ClockPolicy  - a chrono-style clock: time_point and duration types
+//                  and a static now(); steady_clock by default. Spans keep
+//                  its time_point and convert only when they close, with
+//                  the clock's static to_nanoseconds(duration) if it has
+//                  one (e.g. a TSC clock scaling ticks by a calibrated
+//                  rate), else duration_cast. The watchdog and the
+//                  overhead estimate always use clock_type, so the
+//                  clock may have any epoch.
+//   RecordPolicy - how the span keeps its name: OwnedName copies it into
+//                  a std::string, StaticName keeps the pointer (string
+//                  literals only, no allocation).
+//   SinkPolicy   - where a kept span goes: a static emit() taking
+//                  detail::emit_span's parameters. BackendSink hands it to
+//                  the tracer's backend.
+// For example, a span that never allocates for its name:
+//   using LiteralSpan = BasicTraceSpan<clock_type, StaticName>;
+
+namespace detail {
+template <typename Clock, typename = void>
+struct has_to_nanoseconds : std::false_type {};
+
+template <typename Clock>
+struct has_to_nanoseconds<
+    Clock, std::void_t<decltype(Clock::to_nanoseconds(std::declval<typename Clock::duration>()))>>
+    : std::true_type {};
+
+template <typename Clock>
+std::chrono::nanoseconds clock_to_ns(typename Clock::duration d) {
+    if constexpr (has_to_nanoseconds<Clock>::value) {
+        return Clock::to_nanoseconds(d);
+    } else {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+    }
+}
+} // namespace detail
+
+struct OwnedName {
+    using name_type = std::string;
+};
+
+struct StaticName {
+    using name_type = const char*;
+};
+
+struct BackendSink {
+    static void emit(TraceBackend& backend, std::string_view name, uint64_t span_id,
+                     uint64_t parent_id, std::chrono::nanoseconds duration,
+                     uint32_t thread_id, std::chrono::nanoseconds budget,
+                     const detail::SpanArgs* args, const detail::SpanError* error) {
+        detail::emit_span(backend, name, span_id, parent_id, duration, thread_id, budget,
+                          args, error);
+    }
+};
+
+template <typename ClockPolicy = clock_type, typename RecordPolicy = OwnedName,
+          typename SinkPolicy = BackendSink>
+class BasicTraceSpan {
+public:
+    using name_type = typename RecordPolicy::name_type;
+
+    explicit BasicTraceSpan(name_type name) { open(std::move(name)); }
+
+    // A span with a latency budget. Closing later than `budget` flags it
+    // "over_budget", counts a violation for its name and keeps it and its
+    // whole same-thread subtree even if sampling dropped the trace:
+    //   TraceSpan span("cache_get", 200us);
+    BasicTraceSpan(name_type name, std::chrono::nanoseconds budget) {
+        open(std::move(name));
+        set_budget(budget);
+    }
+
+    // A span recorded by `tracer` instead of the global one, in
+    // categories::general and subject to that tracer's filters.
+    BasicTraceSpan(Tracer& tracer, name_type name, std::chrono::nanoseconds budget = {}) {
+        TraceBackend& backend = tracer.backend();
+        if (backend.span_allowed(name, categories::general)) {
+            open(std::move(name), backend);
+            set_budget(budget);
+        }
+    }
+
+    // Used by TRACE_SPAN: does nothing at all while the site is disabled.
+    // `live` is false when a jump-label site has been patched off.
+    explicit BasicTraceSpan(SpanSite& site, bool live = true,
+                            std::chrono::nanoseconds budget = {}) {
+        if (live && site.enabled() &&
+            ((TraceBackend::instance().category_mask() >> site.category()) & 1)) {
+            open(site.name());
+            set_budget(budget);
+        }
+    }
+
+    // Used by TRACE_SPAN: a literal name goes through the site, a runtime
+    // one opens a plain span (see detail::runtime_name).
+    BasicTraceSpan(SpanSite& site, bool live, detail::LiteralName)
+        : BasicTraceSpan(site, live) {}
+
+    BasicTraceSpan(SpanSite&, bool, name_type name) { open(std::move(name)); }
+
+    // Used by FormattedTraceSpan: named by the site's format string until
+    // exported, when `args` (filled in by the caller) are expanded into it.
+    BasicTraceSpan(SpanSite& site, bool live, const detail::SpanArgs* args)
+        : BasicTraceSpan(site, live) {
+        args_ = args;
+    }
+
+    ~BasicTraceSpan() {
+        if (!active_) {
+            return;
+        }
+        auto end_time = ClockPolicy::now();
+        std::chrono::nanoseconds duration =
+            detail::clock_to_ns<ClockPolicy>(end_time - data_.start_time);
+        // Timed on clock_type like the open cost, whatever the policy.
+        int64_t close_from = open_cost_ns_ != 0 ? detail::now_ns() : 0;
+
+        TraceContext& ctx = TraceContext::instance();
+        TraceBackend& backend = *backend_;
+        ctx.open_spans().pop();
+        // Failures are always written, sampled or not, and so is the path
+        // from an unsampled failure up to its root.
+        bool keep = ctx.pop_span();
+        bool exception = std::uncaught_exceptions() > uncaught_exceptions_;
+        if (exception && !error_) {
+            set_error(0, "exception");
+        }
+        if (error_) {
+            ErrorRegistry::instance().record(data_.name, exception);
+            keep = true;
+        }
+        if (keep && !sampled_) {
+            ctx.keep_current();
+        }
+        if (budget_.count() != 0) {
+            close_budgeted(duration, keep);
+        } else if (keep) {
+            emit_span(duration);
+        } else if (duration.count() < backend.config().min_duration_ns) {
+            backend.count_filtered();
+        } else if (sampled_) {
+            emit_span(duration);
+        } else if (!hold_for_budget(duration)) {
+            backend.count_filtered();
+        }
+        if (open_cost_ns_ != 0) {
+            backend.record_overhead(open_cost_ns_ + detail::now_ns() - close_from);
+        }
+    }
+
+    // No copying or moving - RAII ownership
+    BasicTraceSpan(const BasicTraceSpan&) = delete;
+    BasicTraceSpan& operator=(const BasicTraceSpan&) = delete;
+    BasicTraceSpan(BasicTraceSpan&&) = delete;
+    BasicTraceSpan& operator=(BasicTraceSpan&&) = delete;
+
+    uint64_t span_id() const { return data_.span_id; }
+    uint64_t parent_id() const { return data_.parent_id; }
+    bool sampled() const { return sampled_; }
+    bool active() const { return active_; }
+    std::chrono::nanoseconds budget() const { return budget_; }
+
+    // Marks the span failed. It is written with "error":true, the code and
+    // message even if sampling or min_duration_ns would have dropped it,
+    // and counted in span_errors(). A span closed by an exception is marked
+    // automatically, with code 0 and message "exception".
+    void set_error(int32_t code, std::string_view message = {}) {
+        if (!active_) {
+            return;
+        }
+        if (!error_) {
+            error_ = std::make_unique<detail::SpanError>();
+        }
+        error_->code = code;
+        error_->message = message;
+    }
+
+    bool failed() const { return error_ != nullptr; }
+
+    // A timestamped point event on this span, cheaper than a child span:
+    //   span.event("cache_miss", "key", key, "shard", shard);
+    // Attributes are key/value pairs copied raw like TT_LOG arguments.
+    // `name` is stored as a pointer, so it must be a string literal or
+    // otherwise outlive the export. Spans that are not sampled drop them.
+    template <typename... Attrs>
+    void event(const char* name, const Attrs&... attrs) {
+        static_assert(sizeof...(Attrs) % 2 == 0, "event attributes are key/value pairs");
+        if (active_ && sampled_) {
+            detail::emit_event(*backend_, name, data_.span_id, attrs...);
+        }
+    }
+
+private:
+    static const char* c_str(const std::string& name) { return name.c_str(); }
+    static const char* c_str(const char* name) { return name; }
+
+    void open(name_type name, TraceBackend& backend = TraceBackend::instance()) {
+        TraceContext& ctx = TraceContext::instance();
+        int64_t measure_from = ctx.sample_overhead() ? detail::now_ns() : 0;
+        uncaught_exceptions_ = std::uncaught_exceptions();
+        backend_ = &backend;
+        data_.name = std::move(name);
+        detail::OpenFrame parent = detail::innermost_open_span(ctx);
+        data_.span_id = detail::next_span_id();
+        data_.parent_id = parent.span_id;
+        data_.thread_id = ctx.thread_index();
+        // Roots flip the sampling coin; children follow their trace.
+        sampled_ = parent.span_id != 0 ? parent.sampled : ctx.sample(backend.sample_rate());
+        active_ = true;
+        ctx.push_span(data_.span_id, sampled_);
+        data_.start_time = ClockPolicy::now();
+        // The watchdog compares open spans against detail::now_ns().
+        int64_t start_ns;
+        if constexpr (std::is_same_v<ClockPolicy, clock_type>) {
+            start_ns = detail::clock_to_ns<ClockPolicy>(data_.start_time.time_since_epoch())
+                           .count();
+        } else {
+            start_ns = detail::now_ns();
+        }
+        ctx.open_spans().push(data_.span_id, data_.parent_id, c_str(data_.name), start_ns);
+        if (measure_from != 0) {
+            // Includes the open-span publish after the start timestamp.
+            open_cost_ns_ = std::max<int64_t>(detail::now_ns() - measure_from, 1);
+        }
+    }
+
+    void emit_span(std::chrono::nanoseconds duration,
+                   std::chrono::nanoseconds over_budget = {}) {
+        SinkPolicy::emit(*backend_, data_.name, data_.span_id, data_.parent_id, duration,
+                         data_.thread_id, over_budget, args_, error_.get());
+    }
+
+    void set_budget(std::chrono::nanoseconds budget) {
+        if (budget.count() <= 0) {
+            return;
+        }
+        budget_ = budget;
+        if (!sampled_) {
+            detail::BudgetCapture& capture = detail::budget_capture();
+            capture_mark_ = capture.spans.size();
+            ++capture.open;
+        }
+    }
+
+    // Unsampled spans are dropped unless a budgeted ancestor may still
+    // need them. Returns whether the span was held.
+    bool hold_for_budget(std::chrono::nanoseconds duration) {
+        detail::BudgetCapture& capture = detail::budget_capture();
+        if (capture.open == 0 || capture.spans.size() >= detail::BudgetCapture::kMaxSpans) {
+            return false;
+        }
+        std::string name = args_ && args_->encoded
+                               ? detail::expand_span_name(args_->format, args_->bytes,
+                                                          args_->truncated)
+                               : data_.name;
+        capture.spans.push_back({std::move(name), data_.span_id, data_.parent_id, duration,
+                                 data_.thread_id, backend_, &SinkPolicy::emit});
+        return true;
+    }
+
+    // `keep`: the span or an unsampled descendant failed.
+    void close_budgeted(std::chrono::nanoseconds duration, bool keep) {
+        bool over = duration > budget_;
+        if (over) {
+            BudgetRegistry::instance().record(data_.name, (duration - budget_).count());
+        }
+        TraceBackend& backend = *backend_;
+        int64_t min_duration = backend.config().min_duration_ns;
+        if (sampled_) {
+            if (over || keep || duration.count() >= min_duration) {
+                emit_span(duration, over ? budget_ : std::chrono::nanoseconds{});
+            } else {
+                backend.count_filtered();
+            }
+            return;
+        }
+
+        detail::BudgetCapture& capture = detail::budget_capture();
+        --capture.open;
+        if (over || keep) {
+            for (std::size_t i = capture_mark_; i < capture.spans.size(); ++i) {
+                const detail::CapturedSpan& kept = capture.spans[i];
+                kept.sink(*kept.backend, kept.name, kept.span_id, kept.parent_id,
+                          kept.duration, kept.thread_id, {}, nullptr, nullptr);
+            }
+            capture.spans.resize(capture_mark_);
+            emit_span(duration, over ? budget_ : std::chrono::nanoseconds{});
+        } else if (capture.open == 0) {
+            backend.count_filtered(capture.spans.size() + 1);
+            capture.spans.clear();
+        } else if (duration.count() < min_duration || !hold_for_budget(duration)) {
+            backend.count_filtered();
+        }
+    }
+
+    BasicSpanData<name_type, typename ClockPolicy::time_point> data_{};
+    TraceBackend* backend_ = nullptr; // set once the span opens
+    bool sampled_ = false;
+    bool active_ = false;
+    std::chrono::nanoseconds budget_{0};
+    std::size_t capture_mark_ = 0;
+    int64_t open_cost_ns_ = 0; // nonzero when this span samples the overhead
+    const detail::SpanArgs* args_ = nullptr;
+    int uncaught_exceptions_ = 0;
+    std::unique_ptr<detail::SpanError> error_; // set only once the span fails
+};
+
+using TraceSpan = BasicTraceSpan<>;
+
+// ============================================================================
+// FormattedTraceSpan - span named by a format string and raw arguments
+// ============================================================================
+//
+// TRACE_SPAN_FMT("steal_from_{}_to_{}", from, to) keeps the format in its
+// static site and copies the arguments into the record the way TT_LOG
+// does; the name is only built by the writer. A disabled site skips even
+// the copy. Everything
+// keyed by name before export - site rules, the open-span stack, budget
+// statistics - sees the format string.
+
+class FormattedTraceSpan {
+public:
+    template <typename... Args>
+    FormattedTraceSpan(SpanSite& site, bool live, const char* /*format*/,
+                       const Args&... args)
+        : span_(site, live, &args_) {
+        // Even a sampled-out span may be kept later, by a budget, an error
+        // or a failing child, so every active span keeps its arguments.
+        if (span_.active()) {
+            args_.format = site.name();
+            args_.encode(args...);
+        }
+    }
+
+    FormattedTraceSpan(const FormattedTraceSpan&) = delete;
+    FormattedTraceSpan& operator=(const FormattedTraceSpan&) = delete;
+
+    uint64_t span_id() const { return span_.span_id(); }
+    uint64_t parent_id() const { return span_.parent_id(); }
+    bool sampled() const { return span_.sampled(); }
+    bool active() const { return span_.active(); }
+
+    template <typename... Attrs>
+    void event(const char* name, const Attrs&... attrs) {
+        span_.event(name, attrs...);
+    }
+
+    void set_error(int32_t code, std::string_view message = {}) {
+        span_.set_error(code, message);
+    }
+    bool failed() const { return span_.failed(); }
+
+private:
+    detail::SpanArgs args_; // declared first: read by span_'s destructor
+    TraceSpan span_;
+};
+
+// ============================================================================
+// SpanWatchdog - reports spans still open past a deadline
+// ============================================================================
+//
+// A background thread that periodically snapshots every thread's
+// OpenSpanStack. For each thread, the innermost span open longer than the
+// deadline is reported once, with its ancestry followed through parent
+// ids (across threads, for spans handed to a pool). Spans running
+// normally pay nothing beyond publishing themselves on the stack.
+
+struct HungSpan {
+    OpenSpan span;
+    int64_t open_ns = 0;
+    std::vector<OpenSpan> ancestry; // parent first, root last
+};
+
+struct WatchdogOptions {
+    std::chrono::milliseconds deadline{1000};
+    std::chrono::milliseconds interval{100};
+    // Called on the watchdog thread; by default a "hung_span" record is
+    // written to the trace output.
+    std::function<void(const HungSpan&)> on_hung;
+};
+
+inline void format_hung_span_json(std::ostream& out, const HungSpan& hung) {
+    out << R"({"type":"hung_span","name":")";
+    detail::write_json_escaped(out, hung.span.name);
+    out << R"(","span_id":)" << hung.span.span_id << ","
+        << R"("open_us":)" << hung.open_ns / 1000 << ","
+        << R"("thread_id":)" << hung.span.thread_id << R"(,"ancestry":[)";
+    for (std::size_t i = 0; i < hung.ancestry.size(); ++i) {
+        const OpenSpan& up = hung.ancestry[i];
+        out << (i ? "," : "") << R"({"name":")";
+        detail::write_json_escaped(out, up.name);
+        out << R"(","span_id":)" << up.span_id << R"(,"thread_id":)" << up.thread_id << '}';
+    }
+    out << "]}";
+}
+
+namespace detail {
+// A thread calling `tick` every `interval` until stopped. Like the writer
+// it does not survive fork(): owners stop it before and restart it after.
+class PeriodicThread {
+public:
+    PeriodicThread() = default;
+    PeriodicThread(const PeriodicThread&) = delete;
+    PeriodicThread& operator=(const PeriodicThread&) = delete;
+    ~PeriodicThread() { stop(); }
+
+    void start(std::chrono::milliseconds interval, std::function<void()> tick) {
+        stop();
+        interval_ = interval;
+        tick_ = std::move(tick);
+        restart();
+    }
+
+    // Start again with the last interval and callback (used after fork()).
+    void restart() {
+        if (thread_.joinable() || !tick_) {
+            return;
+        }
+        stop_requested_ = false;
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_requested_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    bool running() const { return thread_.joinable(); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval_, [this]() { return stop_requested_; })) {
+            lock.unlock();
+            tick_();
+            lock.lock();
+        }
+    }
+
+    std::chrono::milliseconds interval_{0};
+    std::function<void()> tick_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_requested_ = false;
+};
+} // namespace detail
+
+class SpanWatchdog {
+public:
+    static SpanWatchdog& instance() {
+        static SpanWatchdog* watchdog = new SpanWatchdog();
+        return *watchdog;
+    }
+
+    void start(WatchdogOptions options) {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        thread_.stop();
+        options_ = std::move(options);
+        reported_.clear();
+#if defined(__unix__) || defined(__APPLE__)
+        static std::once_flag registered;
+        std::call_once(registered, []() {
+            pthread_atfork(&SpanWatchdog::on_fork_prepare, &SpanWatchdog::on_fork_resume,
+                           &SpanWatchdog::on_fork_resume);
+        });
+#endif
+        thread_.start(options_.interval, [this]() { report(); });
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        thread_.stop();
+    }
+
+    bool running() const {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        return thread_.running();
+    }
+
+    // One pass over all open spans; returns the spans newly found hung.
+    // The watchdog thread calls this every interval; call it directly
+    // only while that thread is stopped.
+    std::vector<HungSpan> check() {
+        std::vector<OpenSpan> open = OpenSpanRegistry::instance().snapshot();
+        int64_t now = detail::now_ns();
+        int64_t deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            options_.deadline).count();
+
+        std::unordered_map<uint64_t, const OpenSpan*> by_id;
+        for (const OpenSpan& span : open) {
+            by_id.emplace(span.span_id, &span);
+        }
+
+        std::vector<HungSpan> found;
+        std::unordered_set<uint64_t> still_open;
+        // Stacks are outermost first, so the last over-deadline span seen
+        // before the thread changes is that thread's innermost one.
+        for (std::size_t i = 0; i < open.size(); ++i) {
+            const OpenSpan& span = open[i];
+            still_open.insert(span.span_id);
+            bool innermost_hung =
+                now - span.start_ns >= deadline &&
+                (i + 1 == open.size() || open[i + 1].thread_id != span.thread_id ||
+                 now - open[i + 1].start_ns < deadline);
+            if (!innermost_hung || reported_.count(span.span_id)) {
+                continue;
+            }
+            reported_.insert(span.span_id);
+            HungSpan hung;
+            hung.span = span;
+            hung.open_ns = now - span.start_ns;
+            for (uint64_t up = span.parent_id; up != 0 && hung.ancestry.size() < 256;) {
+                auto it = by_id.find(up);
+                if (it == by_id.end()) {
+                    break;
+                }
+                hung.ancestry.push_back(*it->second);
+                up = it->second->parent_id;
+            }
+            found.push_back(std::move(hung));
+        }
+        // Forget closed spans so the set stays small.
+        for (auto it = reported_.begin(); it != reported_.end();) {
+            it = still_open.count(*it) ? std::next(it) : reported_.erase(it);
+        }
+        return found;
+    }
+
+private:
+    SpanWatchdog() = default;
+
+    void report() {
+        for (const HungSpan& hung : check()) {
+            if (options_.on_hung) {
+                options_.on_hung(hung);
+            } else {
+                std::ostringstream json;
+                format_hung_span_json(json, hung);
+                TraceBackend::instance().write_span(json.str());
+            }
+        }
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    static void on_fork_prepare() {
+        SpanWatchdog& self = instance();
+        self.control_mutex_.lock();
+        self.was_running_ = self.thread_.running();
+        self.thread_.stop();
+    }
+
+    static void on_fork_resume() {
+        SpanWatchdog& self = instance();
+        if (self.was_running_) {
+            self.thread_.restart();
+        }
+        self.control_mutex_.unlock();
+    }
+#endif
+
+    mutable std::mutex control_mutex_;
+    WatchdogOptions options_;
+    std::unordered_set<uint64_t> reported_; // watchdog thread only
+    detail::PeriodicThread thread_;
+    bool was_running_ = false;
+};
+
+// ============================================================================
+// OverheadGovernor - keeps the tracer within a CPU budget
+// ============================================================================
+//
+// Every interval the governor estimates the tracer's CPU from its own
+// metrics (spans seen times the sampled per-span overhead, plus time spent
+// writing) and compares it with the process CPU over the same interval.
+// Over budget, it cuts the head-sampling rate in proportion; at the
+// minimum rate it sheds categories, lowest priority first. Below half the
+// budget it recovers in reverse: categories back first, then the rate
+// doubles per interval up to what was configured at start().
+
+struct GovernorOptions {
+    double cpu_budget = 0.01; // tracer share of process CPU
+    std::chrono::milliseconds interval{1000};
+    double min_sample_rate = 0.001;
+    // Disabled in this order once sampling is at min_sample_rate.
+    std::vector<Category> shed_categories;
+};
+
+struct GovernorState {
+    bool running = false;
+    double sample_rate = 1.0;     // currently applied
+    double max_sample_rate = 1.0; // configured rate it recovers to, as of the last step
+    std::size_t shed = 0;         // categories currently shed
+    double overhead = 0.0;        // last measured tracer share of process CPU
+    uint64_t adjustments = 0;
+};
+
+class OverheadGovernor {
+public:
+    static OverheadGovernor& instance() {
+        static OverheadGovernor* governor = new OverheadGovernor();
+        return *governor;
+    }
+
+    // Caps the sampling rate until stop(), starting from the rate
+    // configured now. The cap sits on top of the configured rate, so
+    // config changes made meanwhile still apply below it.
+    void start(GovernorOptions options) {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        stop_locked();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            options_ = std::move(options);
+            state_ = GovernorState{};
+            state_.running = true;
+            state_.sample_rate = TraceBackend::instance().config().sample_rate;
+            state_.max_sample_rate = state_.sample_rate;
+            shed_.clear();
+        }
+        last_ = Sample::take();
+#if defined(__unix__) || defined(__APPLE__)
+        static std::once_flag registered;
+        std::call_once(registered, []() {
+            pthread_atfork(&OverheadGovernor::on_fork_prepare,
+                           &OverheadGovernor::on_fork_resume,
+                           &OverheadGovernor::on_fork_resume);
+        });
+#endif
+        thread_.start(options_.interval, [this]() { tick(); });
+    }
+
+    // Restores the configured rate and every shed category.
+    void stop() {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        stop_locked();
+    }
+
+    GovernorState state() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    // One control step: `tracer_ns` of tracer work against `process_ns` of
+    // process CPU over the last interval. Called by the governor thread.
+    void step(int64_t tracer_ns, int64_t process_ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!state_.running || process_ns <= 0) {
+            return;
+        }
+        double overhead = static_cast<double>(std::max<int64_t>(tracer_ns, 0)) /
+                          static_cast<double>(process_ns);
+        state_.overhead = overhead;
+        state_.max_sample_rate = TraceBackend::instance().config().sample_rate;
+        state_.sample_rate = std::min(state_.sample_rate, state_.max_sample_rate);
+        double budget = options_.cpu_budget;
+        double min_rate = std::min(options_.min_sample_rate, state_.max_sample_rate);
+        double rate = state_.sample_rate;
+        if (overhead > budget) {
+            if (rate > min_rate) {
+                // Not all cost scales with the rate, so aim a bit lower.
+                double factor = std::max(budget / overhead * 0.9, 0.1);
+                set_rate(std::max(rate * factor, min_rate));
+            } else {
+                shed_next();
+            }
+        } else if (overhead < budget / 2) {
+            if (!shed_.empty()) {
+                TraceBackend::instance().set_category_enabled(shed_.back(), true);
+                shed_.pop_back();
+                state_.shed = shed_.size();
+                ++state_.adjustments;
+            } else if (rate < state_.max_sample_rate) {
+                set_rate(std::min(rate * 2, state_.max_sample_rate));
+            }
+        }
+    }
+
+private:
+    // Cumulative counters the tracer cost is derived from.
+    struct Sample {
+        uint64_t spans = 0;
+        int64_t write_ns = 0;
+        int64_t process_ns = 0;
+
+        static Sample take() {
+            TracerMetrics m = TraceBackend::instance().metrics();
+            Sample sample;
+            sample.spans = m.spans_recorded + m.spans_filtered;
+            sample.write_ns = m.write_ns;
+            sample.process_ns = static_cast<int64_t>(
+                static_cast<double>(std::clock()) * 1e9 / CLOCKS_PER_SEC);
+            return sample;
+        }
+    };
+
+    OverheadGovernor() = default;
+
+    // Governor thread only.
+    void tick() {
+        Sample now = Sample::take();
+        int64_t per_span = TraceBackend::instance().metrics().span_overhead_ns;
+        int64_t tracer_ns = static_cast<int64_t>(now.spans - last_.spans) * per_span +
+                            (now.write_ns - last_.write_ns);
+        step(tracer_ns, now.process_ns - last_.process_ns);
+        last_ = now;
+    }
+
+    // Caller holds mutex_.
+    void set_rate(double rate) {
+        state_.sample_rate = rate;
+        ++state_.adjustments;
+        TraceBackend::instance().set_sample_rate_cap(rate);
+    }
+
+    // Caller holds mutex_. Skips categories that are already off.
+    void shed_next() {
+        TraceBackend& backend = TraceBackend::instance();
+        for (Category category : options_.shed_categories) {
+            bool already_shed = std::any_of(shed_.begin(), shed_.end(), [&](Category c) {
+                return c.bit == category.bit;
+            });
+            if (!already_shed && ((backend.category_mask() >> category.bit) & 1)) {
+                backend.set_category_enabled(category, false);
+                shed_.push_back(category);
+                state_.shed = shed_.size();
+                ++state_.adjustments;
+                return;
+            }
+        }
+    }
+
+    // Caller holds control_mutex_.
+    void stop_locked() {
+        thread_.stop();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!state_.running) {
+            return;
+        }
+        for (Category category : shed_) {
+            TraceBackend::instance().set_category_enabled(category, true);
+        }
+        shed_.clear();
+        TraceBackend::instance().set_sample_rate_cap(1.0);
+        state_.sample_rate = TraceBackend::instance().config().sample_rate;
+        state_.running = false;
+        state_.shed = 0;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    static void on_fork_prepare() {
+        OverheadGovernor& self = instance();
+        self.control_mutex_.lock();
+        self.was_running_ = self.thread_.running();
+        self.thread_.stop();
+    }
+
+    static void on_fork_resume() {
+        OverheadGovernor& self = instance();
+        if (self.was_running_) {
+            self.thread_.restart();
+        }
+        self.control_mutex_.unlock();
+    }
+#endif
+
+    std::mutex control_mutex_; // start/stop and the thread
+    mutable std::mutex mutex_; // options_, state_, shed_
+    GovernorOptions options_;
+    GovernorState state_;
+    std::vector<Category> shed_;
+    Sample last_; // governor thread only, once started
+    detail::PeriodicThread thread_;
+    bool was_running_ = false;
+};
+
+// ============================================================================
+// TracedMutex - lock wrappers recording contention and hold times
+// ============================================================================
+//
+// Every acquisition try-locks first. Only when that fails does the caller
+// open a "<name>.wait" span (category lock) and block, so an uncontended
+// lock/unlock costs a try_lock, an unlock and a counter bump. Hold times
+// are sampled every kLockHoldSampleInterval-th exclusive acquisition into a
+// per-name log2 histogram; the sample state lives inside the mutex and is
+// only touched by the holder, so sampling needs no atomics.
+
+constexpr std::size_t kLockHistogramBuckets = 32; // bucket i: [2^(i-1), 2^i) ns
+constexpr uint32_t kLockHoldSampleInterval = 8;   // power of two
+
+struct LockStats {
+    std::string name;
+    std::string wait_span_name;
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::array<std::atomic<uint64_t>, kLockHistogramBuckets> hold_histogram{};
+
+    void record_wait(int64_t ns) {
+        contended.fetch_add(1, std::memory_order_relaxed);
+        wait_ns.fetch_add(static_cast<uint64_t>(std::max<int64_t>(ns, 0)),
+                          std::memory_order_relaxed);
+    }
+
+    void record_hold(int64_t ns) {
+        std::size_t bucket = 0;
+        for (uint64_t v = static_cast<uint64_t>(std::max<int64_t>(ns, 0)); v != 0; v >>= 1) {
+            ++bucket;
+        }
+        hold_histogram[std::min(bucket, kLockHistogramBuckets - 1)].fetch_add(
+            1, std::memory_order_relaxed);
+    }
+};
+
+// Plain copy of one name's counters, as returned by lock_stats().
+struct LockStatsSnapshot {
+    std::string name;
+    uint64_t contended = 0;
+    uint64_t wait_ns = 0;
+    uint64_t hold_samples = 0;
+    std::array<uint64_t, kLockHistogramBuckets> hold_histogram{};
+
+    // Upper bound (ns) of the bucket holding the p-th percentile hold time.
+    uint64_t hold_percentile_ns(double p) const {
+        if (hold_samples == 0) {
+            return 0;
+        }
+        uint64_t rank = std::min(static_cast<uint64_t>(p * static_cast<double>(hold_samples)),
+                                 hold_samples - 1);
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < kLockHistogramBuckets; ++i) {
+            seen += hold_histogram[i];
+            if (seen > rank) {
+                return 1ULL << i;
+            }
+        }
+        return 1ULL << (kLockHistogramBuckets - 1);
+    }
+};
+
+// Stats are shared by every mutex with the same name and never freed, so a
+// mutex can keep a plain pointer to them.
+class LockRegistry {
+public:
+    static LockRegistry& instance() {
+        static LockRegistry registry;
+        return registry;
+    }
+
+    LockStats* stats_for(std::string_view name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& stats : stats_) {
+            if (stats->name == name) {
+                return stats.get();
+            }
+        }
+        stats_.push_back(std::make_unique<LockStats>());
+        LockStats* stats = stats_.back().get();
+        stats->name = std::string(name);
+        stats->wait_span_name = stats->name + ".wait";
+        return stats;
+    }
+
+    std::vector<LockStatsSnapshot> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<LockStatsSnapshot> out;
+        for (const auto& stats : stats_) {
+            LockStatsSnapshot snap;
+            snap.name = stats->name;
+            snap.contended = stats->contended.load(std::memory_order_relaxed);
+            snap.wait_ns = stats->wait_ns.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < kLockHistogramBuckets; ++i) {
+                snap.hold_histogram[i] =
+                    stats->hold_histogram[i].load(std::memory_order_relaxed);
+                snap.hold_samples += snap.hold_histogram[i];
+            }
+            out.push_back(std::move(snap));
+        }
+        return out;
+    }
+
+private:
+    LockRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<LockStats>> stats_;
+};
+
+namespace detail {
+// Slow path shared by the wrappers: `block` acquires the underlying lock.
+template <typename Block>
+void contended_acquire(LockStats& stats, Block&& block) {
+    int64_t start = now_ns();
+    if (compiled_in(categories::lock, Level::info) &&
+        ((TraceBackend::instance().category_mask() >> categories::lock.bit) & 1)) {
+        TraceSpan wait(stats.wait_span_name);
+        block();
+    } else {
+        block();
+    }
+    stats.record_wait(now_ns() - start);
+}
+} // namespace detail
+
+// Drop-in for std::mutex (any Lockable works as `Mutex`), e.g.
+//   tinytrace::TracedMutex cache_mutex{"cache"};
+//   std::lock_guard<tinytrace::TracedMutex> lock(cache_mutex);
+template <typename Mutex>
+class BasicTracedMutex {
+public:
+    explicit BasicTracedMutex(std::string_view name)
+        : stats_(LockRegistry::instance().stats_for(name)) {}
+
+    BasicTracedMutex(const BasicTracedMutex&) = delete;
+    BasicTracedMutex& operator=(const BasicTracedMutex&) = delete;
+
+    void lock() {
+        if (!mutex_.try_lock()) {
+            detail::contended_acquire(*stats_, [this]() { mutex_.lock(); });
+        }
+        on_acquired();
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+        on_acquired();
+        return true;
+    }
+
+    void unlock() {
+        if (hold_start_ns_ != 0) {
+            stats_->record_hold(detail::now_ns() - hold_start_ns_);
+            hold_start_ns_ = 0;
+        }
+        mutex_.unlock();
+    }
+
+    const LockStats& stats() const { return *stats_; }
+
+protected:
+    Mutex mutex_;
+    LockStats* stats_;
+
+private:
+    void on_acquired() {
+        if ((++acquisitions_ & (kLockHoldSampleInterval - 1)) == 0) {
+            hold_start_ns_ = detail::now_ns();
+        }
+    }
+
+    uint32_t acquisitions_ = 0; // guarded by mutex_
+    int64_t hold_start_ns_ = 0; // guarded by mutex_; 0 = not sampled
+};
+
+// Drop-in for std::shared_mutex; also works with std::shared_lock. Shared
+// acquisitions record waits but not hold times, since several readers
+// overlap and there is no single holder to keep the sample.
+template <typename SharedMutex>
+class BasicTracedSharedMutex : public BasicTracedMutex<SharedMutex> {
+public:
+    using BasicTracedMutex<SharedMutex>::BasicTracedMutex;
+
+    void lock_shared() {
+        if (!this->mutex_.try_lock_shared()) {
+            detail::contended_acquire(*this->stats_,
+                                      [this]() { this->mutex_.lock_shared(); });
+        }
+    }
+
+    bool try_lock_shared() { return this->mutex_.try_lock_shared(); }
+    void unlock_shared() { this->mutex_.unlock_shared(); }
+};
+
+using TracedMutex = BasicTracedMutex<std::mutex>;
+using TracedSharedMutex = BasicTracedSharedMutex<std::shared_mutex>;
+
+// ============================================================================
+// TracedExecutor - work-stealing pool that traces its own tasks
+// ============================================================================
+//
+// A task remembers the span that was open when it was submitted and runs
+// under it on the worker, so spans opened inside the task nest correctly
+// across the thread hop. Tasks submitted inside a sampled trace also emit
+// "<name>.queue" (enqueue to start) and "<name>.run" spans. Every task,
+// traced or not, feeds the per-worker counters. Bookkeeping is one clock
+// read at submit and one when the task finishes, which doubles as the next
+// task's start, plus stores to counters only the worker writes.
+
+struct TaskContext {
+    uint64_t parent_id = 0; // span open at submit; 0 = none
+    bool sampled = false;
+    int64_t enqueue_ns = 0;
+
+    static TaskContext capture() {
+        detail::OpenFrame open = detail::innermost_open_span(TraceContext::instance());
+        return {open.span_id, open.sampled, detail::now_ns()};
+    }
+};
+
+namespace detail {
+// Runs `fn` under `context` and returns the time it finished. `start_ns`
+// is when the task was dequeued.
+template <typename F>
+int64_t run_in_context(F& fn, const TaskContext& context, int64_t start_ns,
+                       std::string_view name) {
+    if (context.parent_id == 0) {
+        fn();
+        return now_ns();
+    }
+    TraceContext& ctx = TraceContext::instance();
+    bool traced = context.sampled;
+    uint64_t run_id = traced ? next_span_id() : context.parent_id;
+    // Names are built on the stack: records truncate them anyway. The run
+    // span is published while open so the watchdog can see through it.
+    char buf[kRecordNameCapacity];
+    std::size_t len = std::min(name.size(), kRecordNameCapacity - 8);
+    std::memcpy(buf, name.data(), len);
+    std::memcpy(buf + len, ".run", 5);
+    ctx.push_span(run_id, context.sampled);
+    if (traced) {
+        ctx.open_spans().push(run_id, context.parent_id, buf, start_ns);
+    }
+    fn();
+    if (traced) {
+        ctx.open_spans().pop();
+    }
+    ctx.pop_span();
+    int64_t end_ns = now_ns();
+    if (traced) {
+        uint32_t self = ctx.thread_index();
+        TraceBackend& backend = TraceBackend::instance();
+        emit_span(backend, std::string_view(buf, len + 4), run_id, context.parent_id,
+                  std::chrono::nanoseconds(end_ns - start_ns), self);
+        std::memcpy(buf + len, ".queue", 6);
+        emit_span(backend, std::string_view(buf, len + 6), next_span_id(), context.parent_id,
+                  std::chrono::nanoseconds(start_ns - context.enqueue_ns), self);
+    }
+    return end_ns;
+}
+} // namespace detail
+
+// Adapter for executors we don't own: wrap the callable at submit time and
+// the queue wait, run time and context hop are traced wherever it runs.
+//   pool.post(tinytrace::traced_task("resize", [=] { resize(img); }));
+// `name` must outlive the task (a string literal, typically).
+template <typename F>
+class TracedTask {
+public:
+    TracedTask(std::string_view name, F fn)
+        : fn_(std::move(fn)), name_(name), context_(TaskContext::capture()) {}
+
+    void operator()() { detail::run_in_context(fn_, context_, detail::now_ns(), name_); }
+
+private:
+    F fn_;
+    std::string_view name_;
+    TaskContext context_;
+};
+
+template <typename F>
+TracedTask<std::decay_t<F>> traced_task(std::string_view name, F&& fn) {
+    return TracedTask<std::decay_t<F>>(name, std::forward<F>(fn));
+}
+
+struct WorkerStats {
+    uint64_t tasks = 0;
+    uint64_t steals = 0;   // tasks taken from another worker's deque
+    uint64_t queue_ns = 0; // total enqueue-to-start latency
+    uint64_t run_ns = 0;
+    double utilization = 0.0; // run time / executor lifetime
+};
+
+// Each worker owns a deque: it pushes and pops its own tasks at the back
+// (LIFO, cache-warm) and, when that is empty, steals from the front of the
+// others. Tasks submitted from outside the pool are spread round-robin.
+class TracedExecutor {
+public:
+    explicit TracedExecutor(std::string name,
+                            std::size_t workers = std::thread::hardware_concurrency())
+        : name_(std::move(name)),
+          workers_(std::max<std::size_t>(workers, 1)),
+          started_ns_(detail::now_ns()) {
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i].thread = std::thread([this, i]() { worker_loop(i); });
+        }
+    }
+
+    // Runs everything already submitted, then joins the workers.
+    ~TracedExecutor() {
+        wait_idle();
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (Worker& w : workers_) {
+            w.thread.join();
+        }
+    }
+
+    TracedExecutor(const TracedExecutor&) = delete;
+    TracedExecutor& operator=(const TracedExecutor&) = delete;
+
+    template <typename F>
+    void submit(F&& fn) {
+        Task task{std::function<void()>(std::forward<F>(fn)), TaskContext::capture()};
+        outstanding_.fetch_add(1, std::memory_order_relaxed);
+        // Counted before the push so a worker never sees it go negative.
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        std::size_t self = current_worker();
+        Worker& target = self != kNotAWorker
+                             ? workers_[self]
+                             : workers_[next_.fetch_add(1, std::memory_order_relaxed) %
+                                        workers_.size()];
+        {
+            std::lock_guard<std::mutex> lock(target.mutex);
+            target.tasks.push_back(std::move(task));
+        }
+        if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            work_cv_.notify_one();
+        }
+    }
+
+    // Blocks until every task submitted so far has finished.
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        idle_cv_.wait(lock, [this]() {
+            return outstanding_.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    std::size_t size() const { return workers_.size(); }
+    const std::string& name() const { return name_; }
+
+    std::vector<WorkerStats> stats() const {
+        double lifetime = static_cast<double>(detail::now_ns() - started_ns_);
+        std::vector<WorkerStats> out;
+        for (const Worker& w : workers_) {
+            WorkerStats s;
+            s.tasks = w.executed.load(std::memory_order_relaxed);
+            s.steals = w.steals.load(std::memory_order_relaxed);
+            s.queue_ns = w.queue_ns.load(std::memory_order_relaxed);
+            s.run_ns = w.run_ns.load(std::memory_order_relaxed);
+            s.utilization = lifetime > 0 ? static_cast<double>(s.run_ns) / lifetime : 0.0;
+            out.push_back(s);
+        }
+        return out;
+    }
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        TaskContext context;
+    };
+
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        // Written only by the owning worker; read by stats().
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> queue_ns{0};
+        std::atomic<uint64_t> run_ns{0};
+    };
+
+    static constexpr std::size_t kNotAWorker = SIZE_MAX;
+
+    // Index of the calling thread in this pool, if it is one of our workers.
+    std::size_t current_worker() const {
+        const auto& me = worker_identity();
+        return me.first == this ? me.second : kNotAWorker;
+    }
+
+    static std::pair<const TracedExecutor*, std::size_t>& worker_identity() {
+        thread_local std::pair<const TracedExecutor*, std::size_t> identity{nullptr, 0};
+        return identity;
+    }
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+        counter.store(counter.load(std::memory_order_relaxed) + by,
+                      std::memory_order_relaxed);
+    }
+
+    bool take(std::size_t self, Task& out) {
+        {
+            Worker& own = workers_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                out = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t k = 1; k < workers_.size(); ++k) {
+            Worker& victim = workers_[(self + k) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                bump(workers_[self].steals, 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(std::size_t self) {
+        worker_identity() = {this, self};
+        Worker& me = workers_[self];
+        int64_t now = 0; // end of the previous task, if we did not sleep since
+        Task task;
+        while (true) {
+            if (!take(self, task)) {
+                now = 0;
+                std::unique_lock<std::mutex> lock(sleep_mutex_);
+                sleepers_.fetch_add(1, std::memory_order_seq_cst);
+                work_cv_.wait(lock, [this]() {
+                    return stop_ || pending_.load(std::memory_order_seq_cst) > 0;
+                });
+                sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                if (stop_ && pending_.load(std::memory_order_relaxed) == 0) {
+                    return;
+                }
+                continue;
+            }
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            // A task queued after the previous one ended starts no earlier
+            // than its enqueue, so its .queue span is never negative.
+            int64_t start = std::max(now != 0 ? now : detail::now_ns(),
+                                     task.context.enqueue_ns);
+            now = detail::run_in_context(task.fn, task.context, start, name_);
+            task.fn = nullptr;
+
+            bump(me.executed, 1);
+            bump(me.queue_ns, static_cast<uint64_t>(start - task.context.enqueue_ns));
+            bump(me.run_ns, static_cast<uint64_t>(now - start));
+            if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                idle_cv_.notify_all();
+            }
+        }
+    }
+
+    std::string name_;
+    std::vector<Worker> workers_;
+    int64_t started_ns_;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::size_t> pending_{0};     // queued, not yet taken
+    std::atomic<std::size_t> outstanding_{0}; // submitted, not yet finished
+    std::atomic<std::size_t> sleepers_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    bool stop_ = false; // guarded by sleep_mutex_
+};
+
+// ============================================================================
+// Compiled-out sites
+// ============================================================================
+
+// What TRACE_SPAN_CAT expands to when the build-time filter removes a site:
+// empty, constant-initialized, and never referencing the span name.
+struct NullSite {
+    constexpr NullSite(const char*, const char*, int, uint8_t, Level) {}
+};
+
+class NullSpan {
+public:
+    constexpr NullSpan(NullSite&, bool, std::chrono::nanoseconds = {}) {}
+    uint64_t span_id() const { return 0; }
+    uint64_t parent_id() const { return 0; }
+    bool sampled() const { return false; }
+    bool active() const { return false; }
+    template <typename... Attrs>
+    void event(const char*, const Attrs&...) {}
+    void set_error(int32_t, std::string_view = {}) {}
+    bool failed() const { return false; }
+};
+
+namespace detail {
+template <bool Compiled>
+struct SiteTypes {
+    using site = SpanSite;
+    using span = TraceSpan;
+};
+
+template <>
+struct SiteTypes<false> {
+    using site = NullSite;
+    using span = NullSpan;
+};
+} // namespace detail
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+inline void set_trace_output(const std::string& path) {
+    TraceBackend::instance().set_output_file(path);
+}
+
+inline void flush_traces() {
+    TraceBackend::instance().flush();
+}
+
+// A handoff between threads that is not a parent/child relation, e.g. a
+// request queued by an acceptor and picked up by a worker:
+//   item.flow = tinytrace::flow_begin("accept_to_worker");  // producer
+//   tinytrace::flow_end(item.flow);                          // consumer
+// Each end is one record tagged with the span open at that point and the
+// shared flow_id; the end also reports the wait between the two. `name`
+// must outlive the export (a string literal, typically). Flows started
+// inside an unsampled trace are not recorded.
+struct Flow {
+    uint64_t id = 0; // 0 = not recorded
+    int64_t begin_ns = 0;
+    const char* name = nullptr;
+};
+
+inline Flow flow_begin(const char* name = "flow") {
+    if (!TraceContext::instance().current_sampled()) {
+        return {};
+    }
+    Flow flow{detail::next_span_id(), detail::now_ns(), name};
+    detail::emit_flow(name, flow.id, flow.begin_ns, flow.begin_ns, false);
+    return flow;
+}
+
+inline void flow_end(const Flow& flow) {
+    if (flow.id != 0) {
+        detail::emit_flow(flow.name, flow.id, detail::now_ns(), flow.begin_ns, true);
+    }
+}
+
+// Counter tracks: a numeric value over time (queue depth, cache size,
+// RPCs in flight) on the same timeline as the spans. Each call appends one
+// record; `name` must outlive the export (a string literal, typically).
+//   tinytrace::track_counter("queue_depth", queue.size());
+inline void track_counter(const char* name, double value) {
+    detail::emit_counter(name, value);
+}
+
+// A counter that only records values that differ from the last one, for
+// gauges sampled far more often than they change:
+//   static tinytrace::CounterTrack depth("queue_depth");
+//   depth.set(queue.size());
+// Unsynchronized threads setting the same track may each record a value.
+class CounterTrack {
+public:
+    explicit constexpr CounterTrack(const char* name) : name_(name) {}
+
+    CounterTrack(const CounterTrack&) = delete;
+    CounterTrack& operator=(const CounterTrack&) = delete;
+
+    void set(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        if (last_.load(std::memory_order_relaxed) == bits) {
+            return;
+        }
+        last_.store(bits, std::memory_order_relaxed);
+        detail::emit_counter(name_, value);
+    }
+
+    const char* name() const { return name_; }
+
+private:
+    // Starts as a NaN payload that set() never produces from arithmetic.
+    static constexpr uint64_t kUnset = 0x7ff4'7472'6163'6500ULL;
+
+    const char* name_;
+    std::atomic<uint64_t> last_{kUnset};
+};
+
+// Names the calling thread in the OS (cut to 15 characters there) and in
+// the trace, where a new thread record carries the full name.
+inline void set_thread_name(std::string_view name) {
+#if defined(__linux__)
+    char os_name[16] = {};
+    std::memcpy(os_name, name.data(), std::min(name.size(), sizeof(os_name) - 1));
+    pthread_setname_np(pthread_self(), os_name);
+#endif
+    uint32_t index = detail::thread_index();
+    TraceBackend::write_thread_everywhere(ThreadRegistry::instance().rename(index, name));
+}
+
+// Change settings at runtime, e.g.
+//   tinytrace::configure([](TraceConfig& c) { c.sample_rate = 0.01; });
+template <typename F>
+void configure(F&& mutate) {
+    TraceConfig next = TraceBackend::instance().config();
+    mutate(next);
+    TraceBackend::instance().update_config(next);
+}
+
+inline void watch_config_file(const std::string& path, bool on_sighup = true) {
+    TraceBackend::instance().watch_config_file(path, on_sighup);
+}
+
+// Give each fork() child its own output file, e.g. "traces.{pid}.jsonl".
+inline void set_fork_output_pattern(const std::string& pattern) {
+    TraceBackend::instance().set_fork_output_pattern(pattern);
+}
+
+inline void set_writer_options(const WriterOptions& options) {
+    TraceBackend::instance().set_writer_options(options);
+}
+
+// Turn TRACE_SPAN sites on or off by name glob, e.g. "serialize_*".
+// Applies to sites that have not run yet, too. "*" resets all rules.
+inline void set_span_enabled(std::string_view pattern, bool enabled) {
+    SiteRegistry::instance().set_enabled(pattern, enabled);
+}
+
+// Runtime category filter for TRACE_SPAN_CAT sites that were compiled in.
+inline void set_category_enabled(Category category, bool enabled) {
+    TraceBackend::instance().set_category_enabled(category, enabled);
+}
+
+// Spans open right now on any thread, each thread's outermost first.
+inline std::vector<OpenSpan> open_spans() {
+    return OpenSpanRegistry::instance().snapshot();
+}
+
+// Report spans still open after `options.deadline`; see SpanWatchdog.
+inline void start_watchdog(WatchdogOptions options = {}) {
+    SpanWatchdog::instance().start(std::move(options));
+}
+
+inline void stop_watchdog() {
+    SpanWatchdog::instance().stop();
+}
+
+// Contention and hold-time counters of every TracedMutex name seen so far.
+inline std::vector<LockStatsSnapshot> lock_stats() {
+    return LockRegistry::instance().snapshot();
+}
+
+// The tracer's own counters: spans recorded, dropped and filtered, output
+// volume, buffer depth, writer lag and estimated per-span overhead.
+inline TracerMetrics tracer_metrics() {
+    return TraceBackend::instance().metrics();
+}
+
+// Keep the tracer's CPU under `options.cpu_budget` of the process by
+// lowering the sample rate and shedding categories; see OverheadGovernor.
+inline void start_governor(GovernorOptions options = {}) {
+    OverheadGovernor::instance().start(std::move(options));
+}
+
+inline void stop_governor() {
+    OverheadGovernor::instance().stop();
+}
+
+inline GovernorState governor_state() {
+    return OverheadGovernor::instance().state();
+}
+
+// Spans that closed over their latency budget, counted per name.
+inline std::vector<BudgetViolationStats> budget_violations() {
+    return BudgetRegistry::instance().snapshot();
+}
+
+// Spans that failed (set_error or an exception), counted per name.
+inline std::vector<SpanErrorStats> span_errors() {
+    return ErrorRegistry::instance().snapshot();
+}
+
+// Switch between synchronous output and the buffered modes at runtime.
+// Capacity only applies the first time a mode's buffer is created.
+inline void set_buffer_mode(BufferMode mode,
+                            std::size_t capacity = kDefaultBufferCapacity) {
+    TraceBackend::instance().set_buffer_mode(mode, capacity);
+}
+
+// Optional: scoped macro for convenience. A use with a string literal gets
+// a static SpanSite, so it can be switched off at runtime with
+// set_span_enabled(). Any other string names the span per call, as
+// TraceSpan(name) does.
+#define TINYTRACE_CONCAT_INNER(a, b) a##b
+#define TINYTRACE_CONCAT(a, b) TINYTRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name)                                                      \
+    static ::tinytrace::SpanSite TINYTRACE_CONCAT(_trace_site_, __LINE__){    \
+        ::tinytrace::detail::site_name(name), __FILE__, __LINE__};            \
+    ::tinytrace::TraceSpan TINYTRACE_CONCAT(_trace_span_, __LINE__)(          \
+        TINYTRACE_CONCAT(_trace_site_, __LINE__),                             \
+        TINYTRACE_SITE_LIVE(TINYTRACE_CONCAT(_trace_site_, __LINE__), true),  \
+        ::tinytrace::detail::runtime_name(name))
+
+// Span with a latency budget, e.g. TRACE_SPAN_BUDGET("cache_get", 200us).
+#define TRACE_SPAN_BUDGET(name, budget)                                       \
+    static ::tinytrace::SpanSite TINYTRACE_CONCAT(_trace_site_, __LINE__){    \
+        name, __FILE__, __LINE__};                                            \
+    ::tinytrace::TraceSpan TINYTRACE_CONCAT(_trace_span_, __LINE__)(          \
+        TINYTRACE_CONCAT(_trace_site_, __LINE__),                             \
+        TINYTRACE_SITE_LIVE(TINYTRACE_CONCAT(_trace_site_, __LINE__), true),  \
+        std::chrono::nanoseconds(budget))
+
+// First of the variadic macro arguments, without ##__VA_ARGS__.
+#define TINYTRACE_FIRST(...) TINYTRACE_FIRST_INNER(__VA_ARGS__, 0)
+#define TINYTRACE_FIRST_INNER(first, ...) first
+
+// Span named from a format and arguments, e.g.
+//   TRACE_SPAN_FMT("steal_from_{}_to_{}", from, to);
+// The name is only formatted if the span is exported.
+#define TRACE_SPAN_FMT(...)                                                   \
+    static ::tinytrace::SpanSite TINYTRACE_CONCAT(_trace_site_, __LINE__){    \
+        TINYTRACE_FIRST(__VA_ARGS__), __FILE__, __LINE__};                    \
+    ::tinytrace::FormattedTraceSpan TINYTRACE_CONCAT(_trace_span_, __LINE__)( \
+        TINYTRACE_CONCAT(_trace_site_, __LINE__),                             \
+        TINYTRACE_SITE_LIVE(TINYTRACE_CONCAT(_trace_site_, __LINE__), true),  \
+        __VA_ARGS__)
+
+// Log line tied to the open span, e.g.
+//   TT_LOG(warn, "cache miss for {} after {}us", key, waited);
+// Arguments are copied raw into the span buffers and formatted by the
+// writer. Levels below TINYTRACE_MIN_LEVEL compile to nothing; the
+// log_level setting filters the rest at run time.
+#define TT_LOG(level, ...)                                                    \
+    do {                                                                      \
+        if constexpr (static_cast<int>(::tinytrace::Level::level) >=          \
+                      ::tinytrace::kMinLevel) {                               \
+            static constexpr ::tinytrace::LogSite TINYTRACE_CONCAT(           \
+                _trace_log_, __LINE__){TINYTRACE_FIRST(__VA_ARGS__), __FILE__, \
+                                       __LINE__, ::tinytrace::Level::level};  \
+            ::tinytrace::detail::log(TINYTRACE_CONCAT(_trace_log_, __LINE__), \
+                                     __VA_ARGS__);                            \
+        }                                                                     \
+    } while (0)
+
+// Categorized span, e.g. TRACE_SPAN_CAT(net, debug, "network_roundtrip").
+// `cat` names a tinytrace::categories constant, `level` a tinytrace::Level.
+#define TINYTRACE_COMPILED_IN(cat, level)                                     \
+    ::tinytrace::compiled_in(::tinytrace::categories::cat,                    \
+                             ::tinytrace::Level::level)
+#define TRACE_SPAN_CAT(cat, level, name)                                      \
+    static typename ::tinytrace::detail::SiteTypes<TINYTRACE_COMPILED_IN(     \
+        cat, level)>::site TINYTRACE_CONCAT(_trace_site_, __LINE__){          \
+        name, __FILE__, __LINE__, ::tinytrace::categories::cat.bit,           \
+        ::tinytrace::Level::level};                                           \
+    typename ::tinytrace::detail::SiteTypes<TINYTRACE_COMPILED_IN(            \
+        cat, level)>::span TINYTRACE_CONCAT(_trace_span_, __LINE__)(          \
+        TINYTRACE_CONCAT(_trace_site_, __LINE__),                             \
+        TINYTRACE_SITE_LIVE(TINYTRACE_CONCAT(_trace_site_, __LINE__),         \
+                            TINYTRACE_COMPILED_IN(cat, level)))
+
+// With TINYTRACE_JUMP_LABELS each site carries a 5-byte NOP, like the
+// kernel's static keys. Disabling the site patches the NOP into a jmp past
+// the span, so a disabled site costs one direct jump and not even the flag
+// load. Enabled sites fall through to the usual flag check, which is also
+// what protects them if patching is not permitted.
+//
+// `compiled` is false for sites removed by the build-time filter; the
+// generic lambda's `if constexpr` then discards the asm so no table entry
+// points at a NullSite.
+#if TINYTRACE_USE_JUMP_LABELS
+#define TINYTRACE_SITE_LIVE(site, compiled)                                   \
+    [](auto compiled_tag) -> bool {                                           \
+        if constexpr (decltype(compiled_tag)::value) {                        \
+            __asm__ goto(".balign 8\n\t"                                      \
+                         "1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"          \
+                         ".pushsection __tinytrace_jump, \"aw?\"\n\t"         \
+                         ".balign 8\n\t"                                      \
+                         ".quad 1b, %l[tinytrace_site_off], %c0\n\t"          \
+                         ".popsection\n\t"                                    \
+                         :                                                    \
+                         : "i"(&site)                                         \
+                         :                                                    \
+                         : tinytrace_site_off);                               \
+            return true;                                                      \
+        tinytrace_site_off:                                                   \
+            return false;                                                     \
+        } else {                                                              \
+            return true;                                                      \
+        }                                                                     \
+    }(std::integral_constant<bool, (compiled)>{})
+#else
+#define TINYTRACE_SITE_LIVE(site, compiled) true
+#endif
 
 } // namespace tinytrace
@@ -0,0 +1,344 @@
+#include <tinytrace/instrument.hpp>
+
+#include "symbols.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Everything the hooks can reach must stay out of the instrumentation,
+// even if this file is built with the application's flags.
+#define TINYTRACE_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+namespace tinytrace {
+namespace instrument {
+namespace {
+
+using symbols::AddressRange;
+
+// ============================================================================
+// Filters - rules resolved to sorted ranges, published RCU-style
+// ============================================================================
+
+struct FilterSet {
+    std::vector<AddressRange> include; // sorted, merged; empty = everything
+    std::vector<AddressRange> exclude;
+
+    TINYTRACE_NO_INSTRUMENT static bool contains(const std::vector<AddressRange>& ranges,
+                                                 uint64_t address) {
+        std::size_t lo = 0;
+        std::size_t hi = ranges.size();
+        while (lo < hi) {
+            std::size_t mid = (lo + hi) / 2;
+            if (ranges[mid].end <= address) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < ranges.size() && ranges[lo].begin <= address;
+    }
+
+    TINYTRACE_NO_INSTRUMENT bool allows(uint64_t address) const {
+        return (include.empty() || contains(include, address)) &&
+               !contains(exclude, address);
+    }
+};
+
+void normalize(std::vector<AddressRange>& ranges) {
+    std::sort(ranges.begin(), ranges.end(),
+              [](const AddressRange& a, const AddressRange& b) { return a.begin < b.begin; });
+    std::vector<AddressRange> merged;
+    for (const AddressRange& r : ranges) {
+        if (!merged.empty() && r.begin <= merged.back().end) {
+            merged.back().end = std::max(merged.back().end, r.end);
+        } else {
+            merged.push_back(r);
+        }
+    }
+    ranges = std::move(merged);
+}
+
+struct FilterRules {
+    std::mutex mutex;
+    std::vector<AddressRange> include_ranges;
+    std::vector<AddressRange> exclude_ranges;
+    std::vector<std::string> include_prefixes;
+    std::vector<std::string> exclude_prefixes;
+    // Old snapshots may still be read by a hook, so they are never freed.
+    std::vector<std::unique_ptr<FilterSet>> retired;
+
+    static FilterRules& instance() {
+        static FilterRules* rules = new FilterRules();
+        return *rules;
+    }
+};
+
+// Hot-path state: constant-initialized and trivially destructible, so the
+// hooks stay safe before main() and during thread and process exit.
+std::atomic<bool> g_running{false};
+std::atomic<uint32_t> g_generation{0};
+std::atomic<const FilterSet*> g_filters{nullptr};
+std::atomic<uint64_t> g_dropped{0};
+
+// Caller holds rules.mutex.
+void publish_filters(FilterRules& rules) {
+    auto next = std::make_unique<FilterSet>();
+    next->include = rules.include_ranges;
+    next->exclude = rules.exclude_ranges;
+    for (const std::string& prefix : rules.include_prefixes) {
+        auto found = symbols::resolve_prefix(prefix);
+        next->include.insert(next->include.end(), found.begin(), found.end());
+    }
+    for (const std::string& prefix : rules.exclude_prefixes) {
+        auto found = symbols::resolve_prefix(prefix);
+        next->exclude.insert(next->exclude.end(), found.begin(), found.end());
+    }
+    // A prefix that matched nothing must still restrict the include list.
+    if (next->include.empty() && !rules.include_prefixes.empty()) {
+        next->include.push_back({0, 0});
+    }
+    normalize(next->include);
+    normalize(next->exclude);
+    g_filters.store(next.get(), std::memory_order_release);
+    rules.retired.push_back(std::move(next));
+}
+
+template <typename F>
+void update_rules(F&& mutate) {
+    FilterRules& rules = FilterRules::instance();
+    std::lock_guard<std::mutex> lock(rules.mutex);
+    mutate(rules);
+    publish_filters(rules);
+}
+
+// ============================================================================
+// Per-thread call stack - fixed size, zero-initialized TLS, no destructor
+// ============================================================================
+
+constexpr uint32_t kMaxDepth = 128;
+
+struct Frame {
+    uint64_t fn;
+    uint64_t span_id; // 0 = filtered out, or inside a trace sampled out
+    uint64_t parent_id;
+    int64_t start_ns;
+    bool sampled;     // recorded if this and span_id != 0
+};
+
+struct ThreadState {
+    Frame frames[kMaxDepth];
+    uint32_t depth;      // may exceed kMaxDepth; deeper calls are not recorded
+    uint32_t generation; // stack is stale if start() ran since
+    uint64_t rng;
+    bool busy;           // inside a hook: nested calls are ignored
+};
+
+thread_local ThreadState t_state;
+
+TINYTRACE_NO_INSTRUMENT void record_enter(ThreadState& t, uint64_t fn) {
+    uint32_t generation = g_generation.load(std::memory_order_relaxed);
+    if (t.generation != generation) {
+        t.generation = generation;
+        t.depth = 0;
+    }
+    uint32_t d = t.depth++;
+    if (d >= kMaxDepth) {
+        return;
+    }
+    Frame& f = t.frames[d];
+    f.fn = fn;
+    f.parent_id = 0;
+    f.sampled = true;
+    if (d > 0) {
+        const Frame& up = t.frames[d - 1];
+        f.parent_id = up.span_id != 0 ? up.span_id : up.parent_id;
+        f.sampled = up.sampled;
+    }
+    // A TraceSpan opened since the caller entered is the inner span. Only
+    // read the context if it exists: the hooks run before and after it.
+    if (const TraceContext* ctx = detail::current_context) {
+        uint64_t open = ctx->current_span_id();
+        if (open > f.parent_id) {
+            f.parent_id = open;
+            f.sampled = ctx->current_sampled();
+        }
+    }
+    bool root = f.parent_id == 0;
+    if (root) {
+        if (t.rng == 0) {
+            t.rng = (reinterpret_cast<uintptr_t>(&t) ^ static_cast<uint64_t>(detail::now_ns())) | 1;
+        }
+        f.sampled = detail::sample_coin(
+            t.rng, TraceBackend::instance().sample_rate());
+    }
+    // A sampled-out root still takes an id, so spans under it can tell
+    // they belong to a sampled-out trace.
+    const FilterSet* filters = g_filters.load(std::memory_order_acquire);
+    f.span_id = (f.sampled || root) && (!filters || filters->allows(fn))
+                    ? detail::next_span_id()
+                    : 0;
+    f.start_ns = f.span_id != 0 && f.sampled ? detail::now_ns() : 0;
+}
+
+// Installed as detail::open_frame_hook while running.
+TINYTRACE_NO_INSTRUMENT detail::OpenFrame innermost_frame() {
+    const ThreadState& t = t_state;
+    if (t.depth == 0 || t.generation != g_generation.load(std::memory_order_relaxed)) {
+        return {0, true};
+    }
+    const Frame& f = t.frames[std::min(t.depth, kMaxDepth) - 1];
+    return {f.span_id != 0 ? f.span_id : f.parent_id, f.sampled};
+}
+
+TINYTRACE_NO_INSTRUMENT void record_exit(ThreadState& t, uint64_t fn) {
+    if (t.depth > kMaxDepth) {
+        --t.depth;
+        return;
+    }
+    // Normally the top frame; anything else means frames were skipped by
+    // longjmp or a stop()/start() in between, so resync on the function.
+    uint32_t i = t.depth;
+    while (i > 0 && t.frames[i - 1].fn != fn) {
+        --i;
+    }
+    if (i == 0) {
+        return;
+    }
+    const Frame& f = t.frames[i - 1];
+    t.depth = i - 1;
+    if (f.span_id == 0 || !f.sampled) {
+        return;
+    }
+    int64_t duration = detail::now_ns() - f.start_ns;
+    TraceBackend& backend = TraceBackend::instance();
+    if (duration < backend.config().min_duration_ns) {
+        return;
+    }
+    SpanRecord rec;
+    rec.span_id = f.span_id;
+    rec.parent_id = f.parent_id;
+    rec.duration_ns = duration;
+    rec.thread_id = detail::thread_index();
+    rec.address = fn;
+    rec.name[0] = '\0';
+    if (!backend.submit(rec)) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+__attribute__((constructor)) void start_from_environment() {
+    const char* value = std::getenv("TINYTRACE_INSTRUMENT");
+    if (value && *value && std::strcmp(value, "0") != 0) {
+        start();
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void start(BufferMode mode) {
+    TraceBackend& backend = TraceBackend::instance();
+    symbols::install();
+    if (!backend.buffered()) {
+        backend.set_buffer_mode(mode == BufferMode::direct ? BufferMode::mpsc : mode);
+    }
+    g_generation.fetch_add(1, std::memory_order_relaxed);
+    detail::open_frame_hook.store(&innermost_frame, std::memory_order_release);
+    g_running.store(true, std::memory_order_release);
+}
+
+void stop() {
+    g_running.store(false, std::memory_order_release);
+    detail::open_frame_hook.store(nullptr, std::memory_order_release);
+}
+
+bool running() {
+    return g_running.load(std::memory_order_acquire);
+}
+
+void include_range(const void* begin, const void* end) {
+    update_rules([&](FilterRules& rules) {
+        rules.include_ranges.push_back({reinterpret_cast<uint64_t>(begin),
+                                        reinterpret_cast<uint64_t>(end)});
+    });
+}
+
+void exclude_range(const void* begin, const void* end) {
+    update_rules([&](FilterRules& rules) {
+        rules.exclude_ranges.push_back({reinterpret_cast<uint64_t>(begin),
+                                        reinterpret_cast<uint64_t>(end)});
+    });
+}
+
+void include_symbol_prefix(std::string_view prefix) {
+    update_rules([&](FilterRules& rules) { rules.include_prefixes.emplace_back(prefix); });
+}
+
+void exclude_symbol_prefix(std::string_view prefix) {
+    update_rules([&](FilterRules& rules) { rules.exclude_prefixes.emplace_back(prefix); });
+}
+
+void clear_filters() {
+    update_rules([](FilterRules& rules) {
+        rules.include_ranges.clear();
+        rules.exclude_ranges.clear();
+        rules.include_prefixes.clear();
+        rules.exclude_prefixes.clear();
+    });
+}
+
+void refresh_filters() {
+    update_rules([](FilterRules&) {});
+}
+
+std::string symbolize(const void* address) {
+    return symbols::symbolize(reinterpret_cast<uint64_t>(address));
+}
+
+uint64_t dropped() {
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+} // namespace instrument
+} // namespace tinytrace
+
+// ============================================================================
+// -finstrument-functions hooks
+// ============================================================================
+
+extern "C" TINYTRACE_NO_INSTRUMENT void __cyg_profile_func_enter(void* fn, void*) {
+    using namespace tinytrace::instrument;
+    if (!g_running.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ThreadState& t = t_state;
+    if (t.busy) {
+        return;
+    }
+    t.busy = true;
+    record_enter(t, reinterpret_cast<uint64_t>(fn));
+    t.busy = false;
+}
+
+extern "C" TINYTRACE_NO_INSTRUMENT void __cyg_profile_func_exit(void* fn, void*) {
+    using namespace tinytrace::instrument;
+    if (!g_running.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ThreadState& t = t_state;
+    if (t.busy || t.depth == 0) {
+        return;
+    }
+    t.busy = true;
+    record_exit(t, reinterpret_cast<uint64_t>(fn));
+    t.busy = false;
+}
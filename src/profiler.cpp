@@ -0,0 +1,284 @@
+#include <tinytrace/profiler.hpp>
+
+#include "symbols.hpp"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <vector>
+
+namespace tinytrace {
+namespace profiler {
+namespace {
+
+// ============================================================================
+// Handler state - constant-initialized and trivially destructible, so the
+// signal handler never runs an initializer or touches a destroyed object
+// ============================================================================
+
+struct ThreadState {
+    const TraceContext* context; // null = not profiled
+    uintptr_t stack_low;
+    uintptr_t stack_high;
+    uint32_t generation; // armed during this start() session
+};
+
+thread_local ThreadState t_state;
+
+std::atomic<bool> g_running{false};
+std::atomic<uint32_t> g_generation{0};
+std::atomic<int64_t> g_period_ns{0};
+std::atomic<uint64_t> g_samples{0};
+std::atomic<uint64_t> g_dropped{0};
+
+// Timers of profiled threads, so stop() can delete them from any thread.
+struct ProfiledThread {
+    pid_t tid;
+    timer_t timer;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<ProfiledThread> threads;
+
+    // Leaked on purpose: threads may exit (and unregister) during static
+    // destruction.
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+};
+
+pid_t current_tid() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+bool read_registers(void* ucontext, uintptr_t& pc, uintptr_t& fp, uintptr_t& sp) {
+    const auto* uc = static_cast<const ucontext_t*>(ucontext);
+#if defined(__x86_64__)
+    pc = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+    fp = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RBP]);
+    sp = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RSP]);
+    return true;
+#elif defined(__aarch64__)
+    pc = uc->uc_mcontext.pc;
+    fp = uc->uc_mcontext.regs[29];
+    sp = uc->uc_mcontext.sp;
+    return true;
+#else
+    (void)uc;
+    (void)pc;
+    (void)fp;
+    (void)sp;
+    return false;
+#endif
+}
+
+// Async-signal-safe: no locks, no allocation, and the only memory read
+// outside our own state is the interrupted thread's stack between its
+// stack pointer and the top, which is always mapped.
+void on_sigprof(int, siginfo_t*, void* ucontext) {
+    int saved_errno = errno;
+    const ThreadState& t = t_state;
+    uintptr_t pc = 0;
+    uintptr_t fp = 0;
+    uintptr_t sp = 0;
+    if (t.context && g_running.load(std::memory_order_relaxed) &&
+        read_registers(ucontext, pc, fp, sp)) {
+        SpanRecord rec;
+        rec.kind = RecordKind::sample;
+        rec.span_id = t.context->current_span_id();
+        rec.parent_id = 0;
+        rec.duration_ns = g_period_ns.load(std::memory_order_relaxed);
+        rec.thread_id = t.context->thread_index();
+        rec.address = 0;
+        std::size_t n = 0;
+        rec.frames[n++] = pc;
+        // Frame records are {caller's fp, return address} and move strictly
+        // up the stack; stop at anything else.
+        uintptr_t low = std::max(sp, t.stack_low);
+        while (n < kSampleMaxFrames && fp >= low &&
+               fp + 2 * sizeof(uintptr_t) <= t.stack_high &&
+               fp % alignof(uintptr_t) == 0) {
+            const auto* frame = reinterpret_cast<const uintptr_t*>(fp);
+            if (frame[1] == 0) {
+                break;
+            }
+            rec.frames[n++] = frame[1] - 1; // the call, not the instruction after
+            if (frame[0] <= fp) {
+                break;
+            }
+            fp = frame[0];
+        }
+        rec.frame_count = static_cast<uint8_t>(n);
+        g_samples.fetch_add(1, std::memory_order_relaxed);
+        if (!TraceBackend::instance().submit_from_signal(rec)) {
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    errno = saved_errno;
+}
+
+// ============================================================================
+// Per-thread timers
+// ============================================================================
+
+// Runs on the thread being armed.
+void arm(const TraceContext* context) {
+    ThreadState& t = t_state;
+    uint32_t generation = g_generation.load(std::memory_order_acquire);
+    if (!g_running.load(std::memory_order_acquire) ||
+        (t.context && t.generation == generation)) {
+        return;
+    }
+
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return;
+    }
+    void* stack = nullptr;
+    std::size_t stack_size = 0;
+    int got_stack = pthread_attr_getstack(&attr, &stack, &stack_size);
+    pthread_attr_destroy(&attr);
+    if (got_stack != 0) {
+        return;
+    }
+
+    pid_t tid = current_tid();
+    sigevent event{};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+#if defined(sigev_notify_thread_id)
+    event.sigev_notify_thread_id = tid;
+#else
+    event._sigev_un._tid = tid;
+#endif
+    timer_t timer;
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0) {
+        return;
+    }
+
+    Registry& registry = Registry::instance();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!g_running.load(std::memory_order_acquire)) {
+            timer_delete(timer);
+            return;
+        }
+        registry.threads.push_back({tid, timer});
+    }
+
+    t.stack_low = reinterpret_cast<uintptr_t>(stack);
+    t.stack_high = t.stack_low + stack_size;
+    t.generation = generation;
+    std::atomic_signal_fence(std::memory_order_release);
+    t.context = context;
+    std::atomic_signal_fence(std::memory_order_release);
+
+    int64_t period = g_period_ns.load(std::memory_order_relaxed);
+    itimerspec spec{};
+    spec.it_interval.tv_sec = static_cast<time_t>(period / 1000000000);
+    spec.it_interval.tv_nsec = static_cast<long>(period % 1000000000);
+    spec.it_value = spec.it_interval;
+    timer_settime(timer, 0, &spec, nullptr);
+}
+
+// Runs on the thread being disarmed.
+void disarm() {
+    t_state.context = nullptr;
+    std::atomic_signal_fence(std::memory_order_release);
+
+    pid_t tid = current_tid();
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = std::find_if(registry.threads.begin(), registry.threads.end(),
+                           [tid](const ProfiledThread& p) { return p.tid == tid; });
+    if (it != registry.threads.end()) {
+        timer_delete(it->timer);
+        registry.threads.erase(it);
+    }
+}
+
+void on_thread_start(TraceContext* context) {
+    arm(context);
+}
+
+void on_thread_exit(TraceContext*) {
+    if (t_state.context) {
+        disarm();
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void start(int frequency_hz, BufferMode mode) {
+    // Installed once and never removed: a SIGPROF still pending after
+    // stop() must not hit the default action, which kills the process.
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        struct sigaction action {};
+        action.sa_sigaction = &on_sigprof;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, nullptr);
+    });
+
+    TraceBackend& backend = TraceBackend::instance();
+    symbols::install();
+    if (!backend.buffered()) {
+        backend.set_buffer_mode(mode == BufferMode::direct ? BufferMode::mpsc : mode);
+    }
+
+    g_period_ns.store(1000000000 / std::max(frequency_hz, 1), std::memory_order_relaxed);
+    g_generation.fetch_add(1, std::memory_order_release);
+    g_running.store(true, std::memory_order_release);
+    detail::thread_start_hook.store(&on_thread_start, std::memory_order_release);
+    detail::thread_exit_hook.store(&on_thread_exit, std::memory_order_release);
+    register_thread();
+}
+
+void stop() {
+    detail::thread_start_hook.store(nullptr, std::memory_order_release);
+    g_running.store(false, std::memory_order_release);
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const ProfiledThread& p : registry.threads) {
+        timer_delete(p.timer);
+    }
+    registry.threads.clear();
+}
+
+bool running() {
+    return g_running.load(std::memory_order_acquire);
+}
+
+void register_thread() {
+    arm(&TraceContext::instance());
+}
+
+void unregister_thread() {
+    disarm();
+}
+
+uint64_t samples() {
+    return g_samples.load(std::memory_order_relaxed);
+}
+
+uint64_t dropped() {
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+} // namespace profiler
+} // namespace tinytrace
@@ -0,0 +1,256 @@
+#include "symbols.hpp"
+
+#include <tinytrace/tinytrace.hpp>
+
+#include <cxxabi.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace tinytrace {
+namespace symbols {
+namespace {
+
+struct Symbol {
+    uint64_t begin;
+    uint64_t end;
+    std::string name; // demangled
+    std::string raw;
+};
+
+struct Module {
+    std::string path;
+    uint64_t bias; // load address minus link-time address
+    std::vector<AddressRange> segments;
+    bool loaded = false;
+    std::vector<Symbol> symbols; // sorted by begin
+};
+
+std::string demangle(const char* name) {
+    int status = 0;
+    char* out = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0 || !out) {
+        return name;
+    }
+    std::string result(out);
+    std::free(out);
+    return result;
+}
+
+// STT_FUNC entries from .symtab, or from .dynsym if the object is stripped.
+// Unlike dladdr() this also names static and hidden functions.
+std::vector<Symbol> read_elf_functions(const std::string& path, uint64_t bias) {
+    std::vector<Symbol> symbols;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return symbols;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 ||
+        static_cast<std::size_t>(st.st_size) < sizeof(ElfW(Ehdr))) {
+        ::close(fd);
+        return symbols;
+    }
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return symbols;
+    }
+
+    const char* base = static_cast<const char*>(map);
+    const auto* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(base);
+    bool valid = std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 &&
+                 ehdr->e_shoff != 0 &&
+                 ehdr->e_shentsize == sizeof(ElfW(Shdr)) &&
+                 ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) <= size;
+    if (valid) {
+        const auto* sections = reinterpret_cast<const ElfW(Shdr)*>(base + ehdr->e_shoff);
+        const ElfW(Shdr)* table = nullptr;
+        for (int type : {SHT_SYMTAB, SHT_DYNSYM}) {
+            for (unsigned i = 0; i < ehdr->e_shnum && !table; ++i) {
+                if (sections[i].sh_type == static_cast<ElfW(Word)>(type)) {
+                    table = &sections[i];
+                }
+            }
+        }
+        if (table && table->sh_link < ehdr->e_shnum) {
+            const ElfW(Shdr)& strtab = sections[table->sh_link];
+            if (table->sh_offset + table->sh_size <= size &&
+                strtab.sh_offset + strtab.sh_size <= size) {
+                const auto* syms = reinterpret_cast<const ElfW(Sym)*>(base + table->sh_offset);
+                std::size_t count = table->sh_size / sizeof(ElfW(Sym));
+                const char* names = base + strtab.sh_offset;
+                for (std::size_t i = 0; i < count; ++i) {
+                    const ElfW(Sym)& sym = syms[i];
+                    if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_value == 0 ||
+                        sym.st_shndx == SHN_UNDEF || sym.st_name >= strtab.sh_size) {
+                        continue;
+                    }
+                    uint64_t begin = bias + sym.st_value;
+                    const char* raw = names + sym.st_name;
+                    symbols.push_back({begin, begin + std::max<uint64_t>(sym.st_size, 1),
+                                       demangle(raw), raw});
+                }
+            }
+        }
+    }
+    munmap(map, size);
+
+    std::sort(symbols.begin(), symbols.end(),
+              [](const Symbol& a, const Symbol& b) { return a.begin < b.begin; });
+    symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                              [](const Symbol& a, const Symbol& b) {
+                                  return a.begin == b.begin;
+                              }),
+                  symbols.end());
+    return symbols;
+}
+
+class SymbolTables {
+public:
+    // Leaked on purpose: the backend still symbolizes while it drains
+    // during static destruction.
+    static SymbolTables& instance() {
+        static SymbolTables* tables = new SymbolTables();
+        return *tables;
+    }
+
+    std::string symbolize(uint64_t address) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = cache_.find(address);
+        if (cached != cache_.end()) {
+            return cached->second;
+        }
+        Module* module = find_module(address);
+        if (!module) {
+            refresh_modules();
+            module = find_module(address);
+        }
+        std::string name;
+        if (module) {
+            load(*module);
+            auto it = std::upper_bound(module->symbols.begin(), module->symbols.end(),
+                                       address, [](uint64_t a, const Symbol& s) {
+                                           return a < s.begin;
+                                       });
+            if (it != module->symbols.begin() && address < std::prev(it)->end) {
+                name = std::prev(it)->name;
+            } else {
+                std::ostringstream fallback;
+                std::size_t slash = module->path.rfind('/');
+                fallback << module->path.substr(slash == std::string::npos ? 0 : slash + 1)
+                         << "+0x" << std::hex << (address - module->bias);
+                name = fallback.str();
+            }
+        } else {
+            std::ostringstream hex;
+            hex << "0x" << std::hex << address;
+            name = hex.str();
+        }
+        cache_.emplace(address, name);
+        return name;
+    }
+
+    // Address ranges of every function whose demangled or raw name starts
+    // with `prefix`, across all currently loaded objects.
+    std::vector<AddressRange> resolve_prefix(std::string_view prefix) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refresh_modules();
+        std::vector<AddressRange> ranges;
+        for (Module& module : modules_) {
+            load(module);
+            for (const Symbol& sym : module.symbols) {
+                if (std::string_view(sym.name).substr(0, prefix.size()) == prefix ||
+                    std::string_view(sym.raw).substr(0, prefix.size()) == prefix) {
+                    ranges.push_back({sym.begin, sym.end});
+                }
+            }
+        }
+        return ranges;
+    }
+
+private:
+    SymbolTables() = default;
+
+    Module* find_module(uint64_t address) {
+        for (Module& module : modules_) {
+            for (const AddressRange& seg : module.segments) {
+                if (address >= seg.begin && address < seg.end) {
+                    return &module;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void load(Module& module) {
+        if (!module.loaded) {
+            module.symbols = read_elf_functions(module.path, module.bias);
+            module.loaded = true;
+        }
+    }
+
+    // Picks up objects loaded since the last call; already-parsed modules
+    // keep their tables.
+    void refresh_modules() {
+        std::vector<Module> found;
+        dl_iterate_phdr(
+            [](dl_phdr_info* info, std::size_t, void* out) -> int {
+                Module module;
+                module.path = info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name
+                                                                    : "/proc/self/exe";
+                module.bias = info->dlpi_addr;
+                for (int i = 0; i < info->dlpi_phnum; ++i) {
+                    const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+                    if (ph.p_type == PT_LOAD && (ph.p_flags & PF_X)) {
+                        module.segments.push_back(
+                            {info->dlpi_addr + ph.p_vaddr,
+                             info->dlpi_addr + ph.p_vaddr + ph.p_memsz});
+                    }
+                }
+                static_cast<std::vector<Module>*>(out)->push_back(std::move(module));
+                return 0;
+            },
+            &found);
+        for (Module& module : found) {
+            auto same = std::find_if(modules_.begin(), modules_.end(), [&](const Module& m) {
+                return m.path == module.path && m.bias == module.bias;
+            });
+            if (same != modules_.end()) {
+                module = std::move(*same);
+            }
+        }
+        modules_ = std::move(found);
+    }
+
+    std::mutex mutex_;
+    std::vector<Module> modules_;
+    std::unordered_map<uint64_t, std::string> cache_;
+};
+
+} // namespace
+
+std::string symbolize(uint64_t address) {
+    return SymbolTables::instance().symbolize(address);
+}
+
+std::vector<AddressRange> resolve_prefix(std::string_view prefix) {
+    return SymbolTables::instance().resolve_prefix(prefix);
+}
+
+void install() {
+    TraceBackend::instance().set_symbolizer(&symbolize);
+}
+
+} // namespace symbols
+} // namespace tinytrace
@@ -0,0 +1,32 @@
+#pragma once
+
+// Address-to-name resolution shared by the native libraries. Everything
+// here reads ELF files and allocates, so it only runs on the writer thread
+// or when filters are configured, never in a hook or signal handler.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tinytrace {
+namespace symbols {
+
+struct AddressRange {
+    uint64_t begin;
+    uint64_t end; // exclusive
+};
+
+// Demangled name of the function containing `address`, or
+// "object+0xoffset" / "0x..." when no symbol covers it.
+std::string symbolize(uint64_t address);
+
+// Every function whose demangled or raw name starts with `prefix`, across
+// all currently loaded objects.
+std::vector<AddressRange> resolve_prefix(std::string_view prefix);
+
+// Make the backend name SpanRecord addresses with symbolize().
+void install();
+
+} // namespace symbols
+} // namespace tinytrace
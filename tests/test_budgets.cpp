@@ -0,0 +1,115 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+using namespace std::chrono_literals;
+
+namespace {
+
+BudgetViolationStats violations_named(const std::string& name) {
+    for (auto& stats : budget_violations()) {
+        if (stats.name == name) {
+            return stats;
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Span within budget is neither flagged nor counted", "[budget]") {
+    const std::string test_file = "test_budget_within.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    {
+        TraceSpan span("fast_get", 1s);
+        REQUIRE(span.budget() == 1s);
+    }
+    flush_traces();
+
+    auto lines = lines_containing(test_file, "\"fast_get\"");
+    REQUIRE(lines.size() == 1);
+    REQUIRE(lines[0].find("over_budget") == std::string::npos);
+    REQUIRE(violations_named("fast_get").violations == 0);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Over-budget span keeps its unsampled subtree", "[budget]") {
+    const std::string test_file = "test_budget_over.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    for (int i = 0; i < 2; ++i) {
+        TraceSpan request("slow_get", 1ms);
+        REQUIRE_FALSE(request.sampled());
+        {
+            TraceSpan lookup("slow_lookup");
+            TraceSpan disk("slow_disk");
+            std::this_thread::sleep_for(3ms);
+        }
+    }
+    {
+        TraceSpan request("quick_get", 1s);
+        TraceSpan lookup("quick_lookup");
+    }
+    flush_traces();
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    auto requests = lines_containing(test_file, "\"slow_get\"");
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[0].find("\"over_budget\":true,\"budget_us\":1000") != std::string::npos);
+    REQUIRE(lines_containing(test_file, "\"slow_lookup\"").size() == 2);
+    REQUIRE(lines_containing(test_file, "\"slow_disk\"").size() == 2);
+    // Kept children are not themselves flagged.
+    REQUIRE(lines_containing(test_file, "over_budget").size() == 2);
+    // Within budget and unsampled: nothing is written.
+    REQUIRE(lines_containing(test_file, "quick_").empty());
+
+    auto stats = violations_named("slow_get");
+    REQUIRE(stats.violations == 2);
+    REQUIRE(stats.worst_overrun_ns >= 2000000);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Inner budget violation keeps only the inner subtree", "[budget]") {
+    const std::string test_file = "test_budget_nested.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    {
+        TRACE_SPAN_BUDGET("outer_op", 1s);
+        {
+            TraceSpan sibling("outer_sibling");
+        }
+        TraceSpan inner("inner_op", 1ms);
+        TraceSpan leaf("inner_leaf");
+        std::this_thread::sleep_for(3ms);
+    }
+    flush_traces();
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    set_buffer_mode(BufferMode::direct);
+
+    REQUIRE(lines_containing(test_file, "\"inner_op\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "\"inner_leaf\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "\"outer_op\"").empty());
+    REQUIRE(lines_containing(test_file, "\"outer_sibling\"").empty());
+    REQUIRE(violations_named("inner_op").violations == 1);
+    REQUIRE(violations_named("outer_op").violations == 0);
+
+    std::remove(test_file.c_str());
+}
@@ -0,0 +1,232 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+SpanRecord make_record(uint64_t id, const std::string& name) {
+    SpanRecord rec{};
+    rec.span_id = id;
+    rec.parent_id = 0;
+    rec.duration_ns = 1000;
+    rec.thread_id = detail::thread_index();
+    rec.set_name(name);
+    return rec;
+}
+
+#if TINYTRACE_HAVE_RSEQ
+// After this the calling thread reads cpu_id < 0, like a thread the kernel
+// never registered.
+bool unregister_rseq() {
+    auto* area = reinterpret_cast<struct rseq*>(
+        static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+    return syscall(SYS_rseq, area, sizeof(struct rseq), RSEQ_FLAG_UNREGISTER, RSEQ_SIG) == 0 &&
+           detail::rseq_cpu_id() < 0;
+}
+#endif
+
+} // namespace
+
+TEST_CASE("PerCpuBuffers drains records in order", "[buffering]") {
+    PerCpuBuffers buffers(8, 1);
+
+    for (uint64_t i = 1; i <= 5; ++i) {
+        REQUIRE(buffers.push(make_record(i, "rec")));
+    }
+
+    std::vector<uint64_t> seen;
+    std::size_t n = buffers.drain([&](const SpanRecord& rec) { seen.push_back(rec.span_id); });
+
+    REQUIRE(n == 5);
+    REQUIRE(seen == std::vector<uint64_t>{1, 2, 3, 4, 5});
+    REQUIRE(buffers.drain([](const SpanRecord&) {}) == 0);
+}
+
+TEST_CASE("PerCpuBuffers drops when a ring is full", "[buffering]") {
+    PerCpuBuffers buffers(4, 1);
+
+    for (uint64_t i = 0; i < 4; ++i) {
+        REQUIRE(buffers.push(make_record(i, "fill")));
+    }
+    REQUIRE_FALSE(buffers.push(make_record(99, "overflow")));
+    REQUIRE(buffers.dropped() == 1);
+
+    buffers.drain([](const SpanRecord&) {});
+    REQUIRE(buffers.push(make_record(100, "after_drain")));
+}
+
+#if TINYTRACE_HAVE_RSEQ
+TEST_CASE("Threads without rseq do not share rings with rseq writers", "[buffering][threading]") {
+    PerCpuBuffers buffers(4096, 1);
+    if (!buffers.uses_rseq()) {
+        return; // this libc does not register rseq
+    }
+
+    constexpr uint64_t per_thread = 1000;
+    bool unregistered_ok = false;
+    std::size_t locked_pushed = 0;
+    std::thread unregistered([&]() {
+        unregistered_ok = unregister_rseq();
+        for (uint64_t i = 0; i < per_thread; ++i) {
+            locked_pushed += buffers.push(make_record(per_thread + i, "locked")) != 0;
+        }
+    });
+    for (uint64_t i = 0; i < per_thread; ++i) {
+        REQUIRE(buffers.push(make_record(i, "rseq")));
+    }
+    unregistered.join();
+    REQUIRE(unregistered_ok);
+    REQUIRE(locked_pushed == per_thread);
+
+    // The locked writer had a ring of its own, drained after the CPU's.
+    std::vector<uint64_t> seen;
+    buffers.drain([&](const SpanRecord& rec) { seen.push_back(rec.span_id); });
+    REQUIRE(seen.size() == 2 * per_thread);
+    for (uint64_t i = 0; i < seen.size(); ++i) {
+        REQUIRE(seen[i] == i);
+    }
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Signal handlers never take the locked per-CPU ring", "[buffering][threading]") {
+    if (!PerCpuBuffers(2, 1).uses_rseq()) {
+        return; // this libc does not register rseq
+    }
+    set_buffer_mode(BufferMode::per_cpu);
+    SpanRecord rec = make_record(1, "from_signal");
+    REQUIRE(TraceBackend::instance().submit_from_signal(rec));
+
+    bool unregistered_ok = false;
+    bool submitted = true;
+    std::thread([&]() {
+        unregistered_ok = unregister_rseq();
+        submitted = TraceBackend::instance().submit_from_signal(rec);
+    }).join();
+    REQUIRE(unregistered_ok);
+    REQUIRE_FALSE(submitted);
+}
+#endif
+
+TEST_CASE("SpanRecord truncates long names", "[buffering]") {
+    SpanRecord rec = make_record(1, std::string(500, 'x'));
+    REQUIRE(std::string(rec.name).size() == kRecordNameCapacity - 1);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Per-CPU mode writes every span from many threads", "[buffering][threading]") {
+    const std::string test_file = "test_buffering_output.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    set_buffer_mode(BufferMode::per_cpu);
+
+    constexpr int num_threads = 8;
+    constexpr int spans_per_thread = 200;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([]() {
+            for (int j = 0; j < spans_per_thread; ++j) {
+                TraceSpan span("per_cpu_span");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    std::size_t expected = num_threads * spans_per_thread;
+    REQUIRE(count_lines_containing(test_file, "per_cpu_span") + TraceBackend::instance().dropped_spans() == expected);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("MpscQueue drains in order and drops when full", "[buffering]") {
+    MpscQueue queue(4);
+
+    for (uint64_t i = 1; i <= 4; ++i) {
+        REQUIRE(queue.push(make_record(i, "mpsc")));
+    }
+    REQUIRE_FALSE(queue.push(make_record(5, "overflow")));
+    REQUIRE(queue.dropped() == 1);
+
+    std::vector<uint64_t> seen;
+    REQUIRE(queue.drain([&](const SpanRecord& rec) { seen.push_back(rec.span_id); }, 3) == 3);
+    REQUIRE(queue.drain([&](const SpanRecord& rec) { seen.push_back(rec.span_id); }) == 1);
+    REQUIRE(seen == std::vector<uint64_t>{1, 2, 3, 4});
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "MPSC mode writes every span from many threads", "[buffering][threading]") {
+    const std::string test_file = "test_mpsc_output.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    uint64_t dropped_before = TraceBackend::instance().dropped_spans();
+    set_buffer_mode(BufferMode::mpsc);
+    REQUIRE(TraceBackend::instance().buffer_mode() == BufferMode::mpsc);
+
+    constexpr int num_threads = 8;
+    constexpr int spans_per_thread = 200;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([]() {
+            for (int j = 0; j < spans_per_thread; ++j) {
+                TraceSpan span("mpsc_span");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    std::size_t expected = num_threads * spans_per_thread;
+    uint64_t dropped = TraceBackend::instance().dropped_spans() - dropped_before;
+    REQUIRE(count_lines_containing(test_file, "mpsc_span") + dropped == expected);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Writer wakeup strategies all deliver spans", "[buffering][writer]") {
+    const std::string test_file = "test_writer_output.jsonl";
+
+    const WakeupStrategy strategies[] = {WakeupStrategy::poll, WakeupStrategy::spin,
+                                         WakeupStrategy::notify};
+    for (WakeupStrategy wakeup : strategies) {
+        std::remove(test_file.c_str());
+        set_trace_output(test_file);
+
+        WriterOptions options;
+        options.cpu_affinity = {0};
+        options.sched_idle = true;
+        options.wakeup = wakeup;
+        options.poll_interval = std::chrono::milliseconds(1);
+        options.notify_threshold = 16;
+        set_writer_options(options);
+        set_buffer_mode(BufferMode::mpsc);
+
+        for (int i = 0; i < 100; ++i) {
+            TraceSpan span("writer_strategy_span");
+        }
+
+        // Let the writer drain on its own, without flush_traces().
+        std::size_t lines = 0;
+        for (int attempt = 0; attempt < 200 && lines < 100; ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            lines = count_lines_containing(test_file, "writer_strategy_span");
+        }
+        set_buffer_mode(BufferMode::direct);
+        REQUIRE(lines == 100);
+    }
+
+    set_writer_options(WriterOptions{});
+    std::remove(test_file.c_str());
+}
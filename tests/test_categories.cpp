@@ -0,0 +1,66 @@
+// Build-time filter for this translation unit: drop everything below info
+// and the whole db category.
+#define TINYTRACE_MIN_LEVEL 2
+#define TINYTRACE_COMPILED_CATEGORIES (~(1ULL << 3))
+
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TINYTRACE_DEFINE_CATEGORY(payments, 20)
+
+namespace {
+
+uint64_t net_info() {
+    TRACE_SPAN_CAT(net, info, "cat_network_roundtrip");
+    return TraceContext::instance().current_span_id();
+}
+
+uint64_t rpc_debug() {
+    TRACE_SPAN_CAT(rpc, debug, "cat_serialize_request");
+    return TraceContext::instance().current_span_id();
+}
+
+uint64_t db_error() {
+    TRACE_SPAN_CAT(db, error, "cat_db_query");
+    return TraceContext::instance().current_span_id();
+}
+
+uint64_t payments_warn() {
+    TRACE_SPAN_CAT(payments, warn, "cat_charge_card");
+    return TraceContext::instance().current_span_id();
+}
+
+} // namespace
+
+TEST_CASE("Build-time filter removes low levels and excluded categories", "[categories]") {
+    static_assert(!TINYTRACE_COMPILED_IN(rpc, debug), "debug is below min level");
+    static_assert(!TINYTRACE_COMPILED_IN(db, error), "db is compiled out");
+    static_assert(TINYTRACE_COMPILED_IN(net, info), "net/info is kept");
+
+    TraceSpan outer("cat_outer");
+    REQUIRE(net_info() != outer.span_id());
+    REQUIRE(rpc_debug() == outer.span_id());
+    REQUIRE(db_error() == outer.span_id());
+    REQUIRE(payments_warn() != outer.span_id());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Runtime category mask switches compiled-in categories", "[categories]") {
+    TraceSpan outer("cat_outer");
+
+    set_category_enabled(categories::net, false);
+    REQUIRE(net_info() == outer.span_id());
+    REQUIRE(payments_warn() != outer.span_id());
+
+    set_category_enabled(categories::net, true);
+    REQUIRE(net_info() != outer.span_id());
+
+    configure([](TraceConfig& c) { c.category_mask = ~(1ULL << categories::payments.bit); });
+    REQUIRE(payments_warn() == outer.span_id());
+    configure([](TraceConfig& c) { c.category_mask = ~0ULL; });
+    REQUIRE(payments_warn() != outer.span_id());
+}
@@ -0,0 +1,160 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE("Config settings parse and reject bad values", "[config]") {
+    TraceConfig config;
+
+    REQUIRE(apply_config_setting(config, " sample_rate ", " 0.25 "));
+    REQUIRE(config.sample_rate == 0.25);
+    REQUIRE(apply_config_setting(config, "min_duration_ns", "5000"));
+    REQUIRE(config.min_duration_ns == 5000);
+    REQUIRE(apply_config_setting(config, "buffer_mode", "per_cpu"));
+    REQUIRE(config.buffer_mode == BufferMode::per_cpu);
+
+    REQUIRE_FALSE(apply_config_setting(config, "sample_rate", "lots"));
+    REQUIRE(config.sample_rate == 0.25);
+    REQUIRE_FALSE(apply_config_setting(config, "buffer_mode", "carrier_pigeon"));
+    REQUIRE_FALSE(apply_config_setting(config, "no_such_key", "1"));
+}
+
+TEST_CASE("Config reads TINYTRACE_* environment variables", "[config]") {
+    setenv("TINYTRACE_SAMPLE_RATE", "0.5", 1);
+    setenv("TINYTRACE_MIN_DURATION_NS", "123", 1);
+
+    TraceConfig config;
+    apply_config_env(config);
+    REQUIRE(config.sample_rate == 0.5);
+    REQUIRE(config.min_duration_ns == 123);
+
+    unsetenv("TINYTRACE_SAMPLE_RATE");
+    unsetenv("TINYTRACE_MIN_DURATION_NS");
+}
+
+TEST_CASE("Config file skips comments and blank lines", "[config]") {
+    const std::string path = "test_config_parse.conf";
+    {
+        std::ofstream out(path);
+        out << "# tracing settings\n\nsample_rate = 0.1\nmin_duration_ns=42\n";
+    }
+
+    TraceConfig config;
+    REQUIRE(apply_config_file(config, path));
+    REQUIRE(config.sample_rate == 0.1);
+    REQUIRE(config.min_duration_ns == 42);
+    REQUIRE_FALSE(apply_config_file(config, "does_not_exist.conf"));
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Sampling and min duration filter emitted spans", "[config][sampling]") {
+    const std::string test_file = "test_config_sampling.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+    {
+        TraceSpan root("unsampled_root");
+        REQUIRE_FALSE(root.sampled());
+        TraceSpan child("unsampled_child");
+        REQUIRE_FALSE(child.sampled());
+        REQUIRE(child.parent_id() == root.span_id());
+    }
+
+    configure([](TraceConfig& c) {
+        c.sample_rate = 1.0;
+        c.min_duration_ns = 1000000;
+    });
+    {
+        TraceSpan slow("slow_span");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        TraceSpan fast("fast_span");
+    }
+
+    configure([](TraceConfig& c) { c.min_duration_ns = 0; });
+    flush_traces();
+
+    REQUIRE(count_lines_containing(test_file, "unsampled_") == 0);
+    REQUIRE(count_lines_containing(test_file, "slow_span") == 1);
+    REQUIRE(count_lines_containing(test_file, "fast_span") == 0);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Watched config file is reloaded on change", "[config][reload]") {
+    const std::string path = "test_config_watch.conf";
+    {
+        std::ofstream out(path);
+        out << "sample_rate = 1.0\n";
+    }
+
+    watch_config_file(path, false);
+    REQUIRE(TraceBackend::instance().config().sample_rate == 1.0);
+
+    {
+        std::ofstream out(path);
+        out << "sample_rate = 0.0\n";
+    }
+
+    bool reloaded = false;
+    for (int attempt = 0; attempt < 200 && !reloaded; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        reloaded = TraceBackend::instance().config().sample_rate == 0.0;
+    }
+    REQUIRE(reloaded);
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("SIGHUP wakes every watcher and stop() restores the old handler", "[config][reload]") {
+    const std::string path = "test_config_sighup.conf";
+    {
+        std::ofstream out(path);
+        out << "sample_rate = 1.0\n";
+    }
+
+    struct sigaction original {};
+    struct sigaction ignore {};
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGHUP, &ignore, &original);
+
+    std::atomic<int> first_reloads{0};
+    std::atomic<int> second_reloads{0};
+    {
+        ConfigWatcher first;
+        ConfigWatcher second;
+        first.start(path, true, [&]() { first_reloads.fetch_add(1); });
+        second.start(path, true, [&]() { second_reloads.fetch_add(1); });
+        REQUIRE(first.running());
+        REQUIRE(second.running());
+
+        std::raise(SIGHUP);
+        for (int attempt = 0; attempt < 200 && (first_reloads == 0 || second_reloads == 0); ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        REQUIRE(first_reloads.load() > 0);
+        REQUIRE(second_reloads.load() > 0);
+
+        first.stop();
+        struct sigaction current {};
+        sigaction(SIGHUP, nullptr, &current);
+        REQUIRE(current.sa_handler != SIG_IGN); // second still holds it
+    }
+
+    struct sigaction restored {};
+    sigaction(SIGHUP, &original, &restored);
+    REQUIRE(restored.sa_handler == SIG_IGN);
+
+    std::remove(path.c_str());
+}
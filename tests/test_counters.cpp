@@ -0,0 +1,75 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "track_counter records every value with a timestamp", "[counter]") {
+    const std::string test_file = "test_counter_values.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+
+    track_counter("queue_depth", 3);
+    track_counter("queue_depth", 3);
+    track_counter("queue_depth", 4.5);
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    auto values = lines_containing(test_file, "\"type\":\"counter\",\"name\":\"queue_depth\"");
+    REQUIRE(values.size() == 3);
+    REQUIRE(field(values[0], "value") == "3");
+    REQUIRE(field(values[2], "value") == "4.5");
+    REQUIRE(std::stoll(field(values[2], "ts_ns")) >= std::stoll(field(values[0], "ts_ns")));
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "CounterTrack only records changes", "[counter]") {
+    const std::string test_file = "test_counter_dedup.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    static CounterTrack inflight("inflight_rpcs");
+    for (int v : {0, 0, 2, 2, 2, 1, 0, 0}) {
+        inflight.set(v);
+    }
+    flush_traces();
+
+    auto values = lines_containing(test_file, "\"name\":\"inflight_rpcs\"");
+    REQUIRE(values.size() == 4);
+    REQUIRE(field(values[0], "value") == "0");
+    REQUIRE(field(values[1], "value") == "2");
+    REQUIRE(field(values[2], "value") == "1");
+    REQUIRE(field(values[3], "value") == "0");
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Counter values keep full precision and stay valid JSON", "[counter]") {
+    const std::string test_file = "test_counter_precision.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    track_counter("cache_bytes", 1234567);
+    track_counter("cache_bytes", 0.1);
+    track_counter("cache_bytes", std::numeric_limits<double>::quiet_NaN());
+    track_counter("cache_bytes", -std::numeric_limits<double>::infinity());
+    flush_traces();
+
+    auto values = lines_containing(test_file, "\"name\":\"cache_bytes\"");
+    REQUIRE(values.size() == 4);
+    REQUIRE(field(values[0], "value") == "1234567");
+    REQUIRE(std::stod(field(values[1], "value")) == 0.1);
+    REQUIRE(field(values[2], "value") == "null");
+    REQUIRE(field(values[3], "value") == "null");
+
+    std::remove(test_file.c_str());
+}
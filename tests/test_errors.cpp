@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+void throw_from(int shard) {
+    TRACE_SPAN_FMT("shard_{}_lookup", shard);
+    throw std::runtime_error("oops");
+}
+
+SpanErrorStats errors_named(const std::string& name) {
+    for (auto& stats : span_errors()) {
+        if (stats.name == name) {
+            return stats;
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "set_error marks the span and counts it", "[error]") {
+    const std::string test_file = "test_error_explicit.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    {
+        TraceSpan span("failing_rpc");
+        span.set_error(503, "backend \"users\" unavailable");
+        REQUIRE(span.failed());
+    }
+    {
+        TraceSpan span("healthy_rpc");
+    }
+    flush_traces();
+
+    auto failed = lines_containing(test_file, "\"failing_rpc\"");
+    REQUIRE(failed.size() == 1);
+    REQUIRE(failed[0].find(
+                R"x("error":true,"error_code":503,"error_msg":"backend \"users\" unavailable")x") !=
+            std::string::npos);
+    auto healthy = lines_containing(test_file, "\"healthy_rpc\"");
+    REQUIRE(healthy.size() == 1);
+    REQUIRE(healthy[0].find("\"error\"") == std::string::npos);
+    REQUIRE(errors_named("failing_rpc").errors == 1);
+    REQUIRE(errors_named("failing_rpc").exceptions == 0);
+    REQUIRE(errors_named("healthy_rpc").errors == 0);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "A span closed by an exception is marked failed", "[error]") {
+    const std::string test_file = "test_error_exception.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    try {
+        TraceSpan span("throwing_handler");
+        throw_from(3);
+    } catch (const std::runtime_error&) {
+        TraceSpan handler("error_handler"); // not failed: the exception is caught
+    }
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    auto thrown = lines_containing(test_file, "\"throwing_handler\"");
+    REQUIRE(thrown.size() == 1);
+    REQUIRE(thrown[0].find(R"("error":true,"error_code":0,"error_msg":"exception")") !=
+            std::string::npos);
+    REQUIRE(lines_containing(test_file, "\"error_handler\"")[0].find("\"error\"") ==
+            std::string::npos);
+    REQUIRE(errors_named("throwing_handler").exceptions == 1);
+    auto formatted = lines_containing(test_file, "\"name\":\"shard_3_lookup\"");
+    REQUIRE(formatted.size() == 1);
+    REQUIRE(formatted[0].find("\"error_msg\":\"exception\"") != std::string::npos);
+    REQUIRE(errors_named("shard_{}_lookup").exceptions == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Unsampled failures are kept with the path to their root", "[error]") {
+    const std::string test_file = "test_error_tail.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) {
+        c.sample_rate = 0.0;
+        c.min_duration_ns = 1000000000;
+    });
+
+    {
+        TraceSpan root("tail_root");
+        {
+            TraceSpan sibling("tail_sibling");
+        }
+        {
+            TraceSpan child("tail_child");
+            child.set_error(1, "bad");
+        }
+    }
+    {
+        TraceSpan quiet("tail_quiet_root");
+        TraceSpan child("tail_quiet_child");
+    }
+    configure([](TraceConfig& c) {
+        c.sample_rate = 1.0;
+        c.min_duration_ns = 0;
+    });
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "\"tail_child\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "\"tail_root\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "tail_sibling").empty());
+    REQUIRE(lines_containing(test_file, "tail_quiet").empty());
+    REQUIRE(errors_named("tail_child").errors == 1);
+
+    std::remove(test_file.c_str());
+}
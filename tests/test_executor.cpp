@@ -0,0 +1,102 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE("TracedExecutor runs every task and counts them per worker", "[executor]") {
+    std::atomic<int> ran{0};
+    TracedExecutor pool("count_pool", 4);
+    for (int i = 0; i < 1000; ++i) {
+        pool.submit([&ran]() { ran.fetch_add(1); });
+    }
+    pool.wait_idle();
+
+    REQUIRE(ran.load() == 1000);
+    uint64_t tasks = 0;
+    for (const auto& w : pool.stats()) {
+        tasks += w.tasks;
+        REQUIRE(w.utilization >= 0.0);
+        REQUIRE(w.utilization <= 1.0);
+    }
+    REQUIRE(tasks == 1000);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "TracedExecutor propagates the submitting span into tasks", "[executor]") {
+    const std::string test_file = "test_executor_context.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    uint64_t root_id = 0;
+    uint64_t seen_parent = 0;
+    {
+        TracedExecutor pool("ctx_pool", 2);
+        TraceSpan root("submit_root");
+        root_id = root.span_id();
+        pool.submit([&seen_parent]() {
+            TraceSpan inner("inside_task");
+            seen_parent = inner.parent_id();
+        });
+        pool.wait_idle();
+    }
+    flush_traces();
+
+    auto run = lines_containing(test_file, "\"ctx_pool.run\"");
+    auto queue = lines_containing(test_file, "\"ctx_pool.queue\"");
+    REQUIRE(run.size() == 1);
+    REQUIRE(queue.size() == 1);
+    REQUIRE(field(run[0], "parent_id") == std::to_string(root_id));
+    REQUIRE(field(queue[0], "parent_id") == std::to_string(root_id));
+    REQUIRE(std::to_string(seen_parent) == field(run[0], "span_id"));
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Idle workers steal from a busy worker's deque", "[executor]") {
+    TracedExecutor pool("steal_pool", 4);
+    pool.submit([&pool]() {
+        // Submitted from a worker: all land on this worker's own deque.
+        for (int i = 0; i < 16; ++i) {
+            pool.submit([]() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    });
+    pool.wait_idle();
+
+    uint64_t steals = 0;
+    for (const auto& w : pool.stats()) {
+        steals += w.steals;
+    }
+    REQUIRE(steals > 0);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "traced_task adapts tasks for other executors", "[executor]") {
+    const std::string test_file = "test_executor_adapter.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    uint64_t root_id = 0;
+    {
+        TraceSpan root("adapter_root");
+        root_id = root.span_id();
+        auto task = traced_task("foreign_pool", []() {});
+        std::thread(std::move(task)).join();
+    }
+    flush_traces();
+
+    auto run = lines_containing(test_file, "\"foreign_pool.run\"");
+    REQUIRE(run.size() == 1);
+    REQUIRE(field(run[0], "parent_id") == std::to_string(root_id));
+
+    std::remove(test_file.c_str());
+}
@@ -0,0 +1,74 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "A flow links producer and consumer spans across threads", "[flow]") {
+    const std::string test_file = "test_flow_handoff.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    Flow handoff;
+    uint64_t producer_span = 0;
+    {
+        TraceSpan accept("flow_acceptor");
+        producer_span = accept.span_id();
+        handoff = flow_begin("accept_to_worker");
+    }
+    REQUIRE(handoff.id != 0);
+    uint64_t consumer_span = 0;
+    std::thread worker([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        TraceSpan work("flow_worker");
+        consumer_span = work.span_id();
+        flow_end(handoff);
+    });
+    worker.join();
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    auto begins = lines_containing(test_file, "\"phase\":\"begin\",\"name\":\"accept_to_worker\"");
+    auto ends = lines_containing(test_file, "\"phase\":\"end\",\"name\":\"accept_to_worker\"");
+    REQUIRE(begins.size() == 1);
+    REQUIRE(ends.size() == 1);
+    REQUIRE(field(begins[0], "flow_id") == std::to_string(handoff.id));
+    REQUIRE(field(ends[0], "flow_id") == std::to_string(handoff.id));
+    REQUIRE(field(begins[0], "span_id") == std::to_string(producer_span));
+    REQUIRE(field(ends[0], "span_id") == std::to_string(consumer_span));
+    REQUIRE(field(begins[0], "thread_id") != field(ends[0], "thread_id"));
+    REQUIRE(std::stoll(field(ends[0], "wait_us")) >= 4000);
+    REQUIRE(field(begins[0], "wait_us").empty());
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Flows inside an unsampled trace are not recorded", "[flow]") {
+    const std::string test_file = "test_flow_unsampled.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    Flow handoff;
+    {
+        TraceSpan accept("unsampled_acceptor");
+        handoff = flow_begin("unsampled_flow");
+    }
+    flow_end(handoff);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    flush_traces();
+
+    REQUIRE(handoff.id == 0);
+    REQUIRE(lines_containing(test_file, "unsampled_flow").empty());
+
+    std::remove(test_file.c_str());
+}
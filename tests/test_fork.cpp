@@ -0,0 +1,69 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "Forked child traces to its own file with a live writer", "[fork]") {
+    const std::string parent_file = "test_fork_parent.jsonl";
+    std::remove(parent_file.c_str());
+    set_trace_output(parent_file);
+    set_fork_output_pattern("test_fork_child.{pid}.jsonl");
+    set_buffer_mode(BufferMode::per_cpu);
+
+    {
+        TraceSpan span("before_fork");
+    }
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        // Child: the writer must already be running again, so spans get
+        // drained without an explicit flush.
+        for (int i = 0; i < 10; ++i) {
+            TraceSpan span("in_child");
+        }
+        const std::string child_file =
+            "test_fork_child." + std::to_string(getpid()) + ".jsonl";
+        for (int attempt = 0; attempt < 200; ++attempt) {
+            if (count_lines_containing(child_file, "in_child") == 10) {
+                _exit(0);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        _exit(1);
+    }
+
+    {
+        TraceSpan span("after_fork_parent");
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+    set_fork_output_pattern("");
+
+    const std::string child_file = "test_fork_child." + std::to_string(pid) + ".jsonl";
+    REQUIRE(count_lines_containing(child_file, "before_fork") == 0);
+    REQUIRE(count_lines_containing(parent_file, "before_fork") == 1);
+    REQUIRE(count_lines_containing(parent_file, "after_fork_parent") == 1);
+    REQUIRE(count_lines_containing(parent_file, "in_child") == 0);
+
+    std::remove(child_file.c_str());
+    std::remove(parent_file.c_str());
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+bool category_on(Category category) {
+    return (TraceBackend::instance().category_mask() >> category.bit) & 1;
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Governor cuts sampling, sheds categories, then recovers", "[governor]") {
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    GovernorOptions options;
+    options.cpu_budget = 0.01;
+    options.interval = std::chrono::hours(1); // steps are driven by hand
+    options.min_sample_rate = 0.01;
+    options.shed_categories = {categories::cache, categories::db};
+    start_governor(options);
+    OverheadGovernor& governor = OverheadGovernor::instance();
+
+    // 5% overhead against a 1% budget: the rate drops to about a fifth.
+    governor.step(50, 1000);
+    double rate = governor_state().sample_rate;
+    REQUIRE(rate < 0.2);
+    REQUIRE(TraceBackend::instance().sample_rate() == rate);
+    REQUIRE(TraceBackend::instance().config().sample_rate == 1.0);
+
+    // Still over budget: down to the floor, then categories go in order.
+    for (int i = 0; i < 10 && governor_state().sample_rate > 0.01; ++i) {
+        governor.step(50, 1000);
+    }
+    REQUIRE(governor_state().sample_rate == 0.01);
+    governor.step(50, 1000);
+    REQUIRE_FALSE(category_on(categories::cache));
+    REQUIRE(category_on(categories::db));
+    governor.step(50, 1000);
+    REQUIRE_FALSE(category_on(categories::db));
+    REQUIRE(governor_state().shed == 2);
+
+    // Within budget but above half of it: hold steady.
+    governor.step(8, 1000);
+    REQUIRE(governor_state().shed == 2);
+
+    // Load drops: categories come back first, then the rate.
+    governor.step(1, 1000);
+    REQUIRE(category_on(categories::db));
+    REQUIRE_FALSE(category_on(categories::cache));
+    governor.step(1, 1000);
+    REQUIRE(category_on(categories::cache));
+    REQUIRE(governor_state().sample_rate == 0.01);
+    for (int i = 0; i < 10; ++i) {
+        governor.step(1, 1000);
+    }
+    REQUIRE(governor_state().sample_rate == 1.0);
+    REQUIRE(governor_state().overhead == 0.001);
+
+    stop_governor();
+    REQUIRE_FALSE(governor_state().running);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Stopping the governor restores the configured rate", "[governor]") {
+    configure([](TraceConfig& c) { c.sample_rate = 0.5; });
+    GovernorOptions options;
+    options.interval = std::chrono::hours(1);
+    options.shed_categories = {categories::io};
+    options.min_sample_rate = 0.5;
+    start_governor(options);
+    OverheadGovernor::instance().step(1000, 1000);
+    REQUIRE_FALSE(category_on(categories::io));
+
+    stop_governor();
+    REQUIRE(category_on(categories::io));
+    REQUIRE(TraceBackend::instance().config().sample_rate == 0.5);
+    REQUIRE(TraceBackend::instance().sample_rate() == 0.5);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Governor caps the configured rate without publishing configs", "[governor]") {
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    TraceBackend& backend = TraceBackend::instance();
+    GovernorOptions options;
+    options.cpu_budget = 0.01;
+    options.interval = std::chrono::hours(1);
+    options.min_sample_rate = 0.01;
+    start_governor(options);
+    OverheadGovernor& governor = OverheadGovernor::instance();
+
+    const TraceConfig* snapshot = &backend.config();
+    for (int i = 0; i < 20; ++i) {
+        governor.step(i % 2 == 0 ? 50 : 1, 1000); // oscillating load
+    }
+    REQUIRE(&backend.config() == snapshot);
+
+    governor.step(50, 1000);
+    double cap = governor_state().sample_rate;
+    REQUIRE(cap < 0.2);
+
+    // A reload to a higher rate does not lift the cap...
+    configure([](TraceConfig& c) { c.sample_rate = 0.8; });
+    REQUIRE(backend.sample_rate() == cap);
+    // ...and one below it applies straight away.
+    configure([cap](TraceConfig& c) { c.sample_rate = cap / 2; });
+    REQUIRE(backend.sample_rate() == cap / 2);
+    governor.step(8, 1000);
+    REQUIRE(governor_state().sample_rate == cap / 2);
+    REQUIRE(governor_state().max_sample_rate == cap / 2);
+
+    // Recovery climbs back to the rate configured now.
+    configure([](TraceConfig& c) { c.sample_rate = 0.8; });
+    for (int i = 0; i < 20; ++i) {
+        governor.step(1, 1000);
+    }
+    REQUIRE(governor_state().sample_rate == 0.8);
+    REQUIRE(backend.sample_rate() == 0.8);
+
+    stop_governor();
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    REQUIRE(backend.sample_rate() == 1.0);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Governor thread lowers sampling when tracing is costly", "[governor]") {
+    const std::string test_file = "test_governor_load.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    GovernorOptions options;
+    options.cpu_budget = 1e-6; // nothing fits
+    options.interval = std::chrono::milliseconds(10);
+    start_governor(options);
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (std::chrono::steady_clock::now() < until &&
+           governor_state().sample_rate == 1.0) {
+        TraceSpan span("governed_span");
+    }
+    GovernorState state = governor_state();
+    stop_governor();
+
+    REQUIRE(state.running);
+    REQUIRE(state.sample_rate < 1.0);
+    REQUIRE(state.overhead > 1e-6);
+    REQUIRE(TraceBackend::instance().config().sample_rate == 1.0);
+
+    std::remove(test_file.c_str());
+}
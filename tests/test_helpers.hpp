@@ -0,0 +1,78 @@
+// Helpers shared by the test files.
+#pragma once
+
+#include <tinytrace/tinytrace.hpp>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace test_helpers {
+
+inline std::vector<std::string> lines_containing(const std::string& path,
+                                                 const std::string& needle) {
+    std::ifstream in(path);
+    std::string line;
+    std::vector<std::string> found;
+    while (std::getline(in, line)) {
+        if (line.find(needle) != std::string::npos) {
+            found.push_back(line);
+        }
+    }
+    return found;
+}
+
+inline std::size_t count_lines_containing(const std::string& path, const std::string& needle) {
+    return lines_containing(path, needle).size();
+}
+
+// The raw value of `"key":` in a JSON line, e.g. `42` or `"name"`.
+inline std::string field(const std::string& line, const std::string& key) {
+    std::string needle = "\"" + key + "\":";
+    std::size_t at = line.find(needle);
+    if (at == std::string::npos) {
+        return {};
+    }
+    at += needle.size();
+    std::size_t end = line.find_first_of(",}", at);
+    return line.substr(at, end - at);
+}
+
+// Catch2 fixture for tests that change the global tracer, used as
+// TEST_CASE_METHOD(GlobalTracerState, ...). When the test case ends, pass
+// or fail, it puts back the settings, output, buffer mode, writer options
+// and span and category filters it found.
+class GlobalTracerState {
+public:
+    GlobalTracerState()
+        : config_(tinytrace::TraceBackend::instance().config()),
+          writer_(tinytrace::TraceBackend::instance().writer_options()),
+          category_mask_(tinytrace::TraceBackend::instance().category_mask()) {}
+
+    GlobalTracerState(const GlobalTracerState&) = delete;
+    GlobalTracerState& operator=(const GlobalTracerState&) = delete;
+
+    ~GlobalTracerState() {
+        tinytrace::TraceBackend& backend = tinytrace::TraceBackend::instance();
+        backend.update_config(config_);
+        backend.set_buffer_mode(config_.buffer_mode, config_.buffer_capacity);
+        backend.set_writer_options(writer_);
+        backend.set_output_file(config_.output);
+        backend.set_sample_rate_cap(1.0);
+        for (uint8_t bit = 0; bit < 64; ++bit) {
+            backend.set_category_enabled({bit, nullptr}, (category_mask_ >> bit) & 1);
+        }
+        tinytrace::set_span_enabled("*", true);
+        tinytrace::detail::any_glob(config_.disabled_spans, [](std::string_view glob) {
+            tinytrace::set_span_enabled(glob, false);
+            return false;
+        });
+    }
+
+private:
+    tinytrace::TraceConfig config_;
+    tinytrace::WriterOptions writer_;
+    uint64_t category_mask_;
+};
+
+} // namespace test_helpers
@@ -0,0 +1,161 @@
+// Built with -finstrument-functions (see tests/CMakeLists.txt).
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/instrument.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace instrumented {
+
+volatile int sink = 0;
+
+__attribute__((noinline)) void leaf() {
+    sink = sink + 1;
+}
+
+__attribute__((noinline)) void outer() {
+    leaf();
+    leaf();
+}
+
+__attribute__((noinline)) uint64_t with_span() {
+    TraceSpan span("instrument_inner_span");
+    leaf();
+    return span.parent_id();
+}
+
+} // namespace instrumented
+
+namespace {
+
+__attribute__((noinline)) int file_local_helper() {
+    return instrumented::sink;
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Instrumented calls become symbolized, nested spans", "[instrument]") {
+    const std::string path = "test_instrument_calls.jsonl";
+    std::remove(path.c_str());
+    set_trace_output(path);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    instrument::clear_filters();
+    instrument::include_symbol_prefix("instrumented::");
+
+    instrument::start();
+    REQUIRE(instrument::running());
+    REQUIRE(TraceBackend::instance().buffered());
+    instrumented::outer();
+    instrument::stop();
+    instrumented::outer();
+    flush_traces();
+
+    auto outer = lines_containing(path, "\"instrumented::outer()\"");
+    auto leaves = lines_containing(path, "\"instrumented::leaf()\"");
+    REQUIRE(outer.size() == 1);
+    REQUIRE(leaves.size() == 2);
+    for (const auto& leaf : leaves) {
+        REQUIRE(field(leaf, "parent_id") == field(outer[0], "span_id"));
+    }
+    // Everything else in this file is instrumented too but not included.
+    REQUIRE(lines_containing(path, "C_A_T_C_H").empty());
+    REQUIRE(lines_containing(path, "lines_containing").empty());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Instrumentation honours exclude prefixes and ranges", "[instrument]") {
+    const std::string path = "test_instrument_filters.jsonl";
+    std::remove(path.c_str());
+    set_trace_output(path);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    instrument::clear_filters();
+    instrument::include_symbol_prefix("instrumented::");
+    instrument::exclude_symbol_prefix("instrumented::leaf");
+
+    instrument::start();
+    instrumented::outer();
+    flush_traces();
+    REQUIRE(lines_containing(path, "instrumented::outer()").size() == 1);
+    REQUIRE(lines_containing(path, "instrumented::leaf()").empty());
+
+    auto outer_fn = reinterpret_cast<const char*>(&instrumented::outer);
+    instrument::exclude_range(outer_fn, outer_fn + 1);
+    instrumented::outer();
+    instrument::stop();
+    flush_traces();
+    REQUIRE(lines_containing(path, "instrumented::outer()").size() == 1);
+
+    instrument::clear_filters();
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Instrumented calls and TraceSpans nest under each other", "[instrument]") {
+    const std::string path = "test_instrument_nesting.jsonl";
+    std::remove(path.c_str());
+    set_trace_output(path);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    instrument::clear_filters();
+    instrument::include_symbol_prefix("instrumented::");
+
+    instrument::start();
+    uint64_t outer_id = 0;
+    {
+        TraceSpan outer("instrument_outer_span");
+        outer_id = outer.span_id();
+        instrumented::with_span();
+    }
+    instrument::stop();
+    flush_traces();
+
+    auto with_span = lines_containing(path, "\"instrumented::with_span()\"");
+    auto inner = lines_containing(path, "\"name\":\"instrument_inner_span\"");
+    auto leaf = lines_containing(path, "\"instrumented::leaf()\"");
+    REQUIRE(with_span.size() == 1);
+    REQUIRE(inner.size() == 1);
+    REQUIRE(leaf.size() == 1);
+    REQUIRE(field(with_span[0], "parent_id") == std::to_string(outer_id));
+    REQUIRE(field(inner[0], "parent_id") == field(with_span[0], "span_id"));
+    REQUIRE(field(leaf[0], "parent_id") == field(inner[0], "span_id"));
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Instrumented calls follow the sampling of the open TraceSpan", "[instrument]") {
+    const std::string path = "test_instrument_sampling.jsonl";
+    std::remove(path.c_str());
+    set_trace_output(path);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+    instrument::clear_filters();
+    instrument::include_symbol_prefix("instrumented::");
+
+    instrument::start();
+    {
+        TraceSpan unsampled("instrument_unsampled_span");
+        configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+        instrumented::outer();
+    }
+    instrumented::with_span();
+    instrument::stop();
+    flush_traces();
+
+    // outer() joined the sampled-out trace; with_span() started a sampled
+    // one that its TraceSpan and leaf() followed.
+    REQUIRE(lines_containing(path, "instrumented::outer()").empty());
+    REQUIRE(lines_containing(path, "instrumented::leaf()").size() == 1);
+    REQUIRE(lines_containing(path, "\"instrumented::with_span()\"").size() == 1);
+    auto inner = lines_containing(path, "\"name\":\"instrument_inner_span\"");
+    REQUIRE(inner.size() == 1);
+    REQUIRE(field(inner[0], "parent_id") != "0");
+}
+
+TEST_CASE("Symbolization reads the ELF symbol table", "[instrument]") {
+    // Internal linkage: not visible to dladdr(), only to .symtab.
+    REQUIRE(instrument::symbolize(reinterpret_cast<const void*>(&file_local_helper))
+                .find("file_local_helper") != std::string::npos);
+    REQUIRE(instrument::symbolize(reinterpret_cast<const void*>(&instrumented::leaf)) ==
+            "instrumented::leaf()");
+    auto inside = reinterpret_cast<const char*>(&instrumented::leaf) + 1;
+    REQUIRE(instrument::symbolize(inside) == "instrumented::leaf()");
+}
@@ -0,0 +1,50 @@
+#define TINYTRACE_JUMP_LABELS 1
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+#if TINYTRACE_USE_JUMP_LABELS
+
+namespace {
+
+uint64_t jump_site_call() {
+    TRACE_SPAN("jump_label_site");
+    return TraceContext::instance().current_span_id();
+}
+
+const detail::JumpEntry* find_entry(const char* name) {
+    for (auto* e = __start___tinytrace_jump; e != __stop___tinytrace_jump; ++e) {
+        const char* site_name = reinterpret_cast<const SpanSite*>(e->key)->name();
+        if (site_name && std::string(site_name) == name) { // null: runtime-named
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Jump-label sites are patched on enable/disable", "[sites][jump_labels]") {
+    const detail::JumpEntry* entry = find_entry("jump_label_site");
+    REQUIRE(entry != nullptr);
+    REQUIRE(entry->code % 8 == 0);
+    const auto* code = reinterpret_cast<const unsigned char*>(entry->code);
+    REQUIRE(code[0] == 0x0f); // starts as a NOP
+
+    TraceSpan outer("jump_outer");
+    REQUIRE(jump_site_call() != outer.span_id());
+
+    set_span_enabled("jump_label_*", false);
+    REQUIRE(code[0] == 0xe9); // now a jmp
+    REQUIRE(jump_site_call() == outer.span_id());
+
+    set_span_enabled("*", true);
+    REQUIRE(code[0] == 0x0f);
+    REQUIRE(jump_site_call() != outer.span_id());
+}
+
+#endif
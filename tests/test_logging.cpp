@@ -0,0 +1,84 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "TT_LOG formats its arguments and joins the open span", "[log]") {
+    const std::string test_file = "test_log_direct.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    uint64_t span_id = 0;
+    {
+        TraceSpan span("logging_request");
+        span_id = span.span_id();
+        std::string user = "bob";
+        TT_LOG(info, "user {} got {} items, ratio {}, cached={}, id={}", user, 7u, 0.5, true,
+               -3);
+    }
+    TT_LOG(warn, "no span {{here}}");
+    flush_traces();
+
+    auto logs = lines_containing(test_file, "\"type\":\"log\"");
+    REQUIRE(logs.size() == 2);
+    REQUIRE(logs[0].find("\"msg\":\"user bob got 7 items, ratio 0.5, cached=true, id=-3\"") !=
+            std::string::npos);
+    REQUIRE(field(logs[0], "span_id") == std::to_string(span_id));
+    REQUIRE(logs[0].find("\"level\":\"info\"") != std::string::npos);
+    REQUIRE(logs[0].find("test_logging.cpp") != std::string::npos);
+    REQUIRE(logs[1].find("\"msg\":\"no span {here}\"") != std::string::npos);
+    REQUIRE(field(logs[1], "span_id") == "0");
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Buffered TT_LOG is formatted by the writer", "[log]") {
+    const std::string test_file = "test_log_buffered.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+
+    {
+        TraceSpan span("buffered_logging");
+        const char* quoted = "say \"hi\"";
+        TT_LOG(error, "failed: {} (missing {})", quoted);
+    }
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    auto logs = lines_containing(test_file, "\"type\":\"log\"");
+    REQUIRE(logs.size() == 1);
+    REQUIRE(logs[0].find(R"x("msg":"failed: say \"hi\" (missing {?})")x") != std::string::npos);
+    REQUIRE(logs[0].find("\"level\":\"error\"") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "TT_LOG honours log_level and truncates long arguments", "[log]") {
+    const std::string test_file = "test_log_filter.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    TT_LOG(debug, "hidden {}", 1);
+    configure([](TraceConfig& c) { c.log_level = Level::debug; });
+    TT_LOG(debug, "shown {}", 2);
+    configure([](TraceConfig& c) { c.log_level = Level::info; });
+    TT_LOG(info, "long {} then {}", std::string(200, 'x'), 3);
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "hidden").empty());
+    REQUIRE(lines_containing(test_file, "\"msg\":\"shown 2\"").size() == 1);
+    auto long_line = lines_containing(test_file, "\"msg\":\"long x");
+    REQUIRE(long_line.size() == 1);
+    REQUIRE(long_line[0].find("then {?}...\"") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
@@ -0,0 +1,111 @@
+// Built with -fno-omit-frame-pointer (see tests/CMakeLists.txt).
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/profiler.hpp>
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+volatile uint64_t sink = 0;
+
+int64_t thread_cpu_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Spins until this thread has used `cpu_time` of CPU, which is what the
+// profiler's timers count, so a loaded machine only makes it take longer.
+constexpr std::chrono::milliseconds kBurnCpu{200};
+
+__attribute__((noinline)) void burn_cpu(std::chrono::milliseconds cpu_time) {
+    int64_t deadline = thread_cpu_ns() +
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(cpu_time).count();
+    while (thread_cpu_ns() < deadline) {
+        for (int i = 0; i < 1000; ++i) {
+            sink = sink + static_cast<uint64_t>(i);
+        }
+    }
+}
+
+// CPU timers expire on the scheduler tick, so even at 1000 Hz a thread
+// gets at least one sample per 10 ms of CPU (HZ=100); ask for half that.
+constexpr std::size_t kMinSamples = static_cast<std::size_t>(kBurnCpu.count() / 10 / 2);
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Profiler samples are tagged with the open span", "[profiler]") {
+    const std::string test_file = "test_profiler_span.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    uint64_t hot_id = 0;
+    profiler::start(1000);
+    {
+        TraceSpan hot("hot_span");
+        hot_id = hot.span_id();
+        burn_cpu(kBurnCpu);
+    }
+    profiler::stop();
+    flush_traces();
+
+    REQUIRE(profiler::samples() > 0);
+    auto samples = lines_containing(test_file, "\"type\":\"sample\"");
+    auto tagged = lines_containing(test_file, "\"span_id\":" + std::to_string(hot_id) + ",");
+    REQUIRE(samples.size() >= kMinSamples);
+    std::size_t in_burn = 0;
+    for (const auto& line : tagged) {
+        if (line.find("\"type\":\"sample\"") != std::string::npos &&
+            line.find("burn_cpu") != std::string::npos) {
+            ++in_burn;
+        }
+    }
+    REQUIRE(in_burn >= samples.size() / 2);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Threads that start tracing after start() are profiled", "[profiler]") {
+    const std::string test_file = "test_profiler_thread.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    profiler::start(1000);
+    uint64_t worker_span = 0;
+    std::thread worker([&worker_span]() {
+        TraceSpan span("worker_hot_span");
+        worker_span = span.span_id();
+        burn_cpu(kBurnCpu);
+    });
+    worker.join();
+    profiler::stop();
+    flush_traces();
+
+    auto tagged = lines_containing(test_file, "\"span_id\":" + std::to_string(worker_span) + ",");
+    std::size_t samples = 0;
+    for (const auto& line : tagged) {
+        samples += line.find("\"type\":\"sample\"") != std::string::npos;
+    }
+    REQUIRE(samples >= kMinSamples);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Profiler stack frames are escaped in JSON", "[profiler]") {
+    std::ostringstream out;
+    format_sample_json(out, 7, 1, {"operator\"\" _ms(unsigned long long)", "main"});
+    REQUIRE(out.str() ==
+            R"({"type":"sample","span_id":7,"thread_id":1,)"
+            R"json("stack":["operator\"\" _ms(unsigned long long)","main"]})json");
+}
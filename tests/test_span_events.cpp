@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "Span events carry the span id, a timestamp and attributes", "[event]") {
+    const std::string test_file = "test_event_direct.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    uint64_t span_id = 0;
+    {
+        TraceSpan span("event_owner");
+        span_id = span.span_id();
+        span.event("cache_miss");
+        std::string key = "user \"7\"";
+        span.event("retry", "key", key, "attempt", 3, "backoff", 0.5, "final", false);
+    }
+    flush_traces();
+
+    auto events = lines_containing(test_file, "\"type\":\"event\"");
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[0].find("\"name\":\"cache_miss\"") != std::string::npos);
+    REQUIRE(events[0].find("\"attrs\":{}") != std::string::npos);
+    REQUIRE(field(events[0], "span_id") == std::to_string(span_id));
+    REQUIRE(std::stoll(field(events[1], "ts_ns")) >= std::stoll(field(events[0], "ts_ns")));
+    REQUIRE(events[1].find(
+                R"x("attrs":{"key":"user \"7\"","attempt":3,"backoff":0.5,"final":false})x") !=
+            std::string::npos);
+    // Events are not child spans.
+    REQUIRE(lines_containing(test_file, "\"duration_us\"").size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Buffered span events are formatted by the writer", "[event]") {
+    const std::string test_file = "test_event_buffered.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    {
+        TraceSpan span("buffered_event_owner");
+        span.event("lookup", "key", std::string(200, 'k'), "shard", 4);
+    }
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    auto events = lines_containing(test_file, "\"name\":\"lookup\"");
+    REQUIRE(events.size() == 1);
+    REQUIRE(events[0].find("\"shard\":null") == std::string::npos);
+    REQUIRE(events[0].find("\"attrs_truncated\":true") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Unsampled spans drop their events", "[event]") {
+    const std::string test_file = "test_event_unsampled.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    {
+        TraceSpan span("unsampled_event_owner");
+        span.event("dropped_event");
+    }
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "dropped_event").empty());
+
+    std::remove(test_file.c_str());
+}
@@ -0,0 +1,149 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+using namespace std::chrono_literals;
+
+namespace {
+
+void steal(int from, int to) {
+    TRACE_SPAN_FMT("steal_from_{}_to_{}", from, to);
+}
+
+void steal_failing(int from, int to) {
+    TRACE_SPAN_FMT("failed_steal_{}_to_{}", from, to);
+    TraceSpan child("failed_steal_child");
+    child.set_error(1, "empty deque");
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "TRACE_SPAN_FMT names the span from its arguments", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_direct.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    steal(3, 7);
+    {
+        std::string key = "say \"hi\"";
+        TRACE_SPAN_FMT("lookup {} {{raw}}", key);
+    }
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "\"name\":\"steal_from_3_to_7\"").size() == 1);
+    REQUIRE(lines_containing(test_file, R"x("name":"lookup say \"hi\" {raw}")x").size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Buffered TRACE_SPAN_FMT is formatted by the writer", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_buffered.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    steal(1, 2);
+    {
+        TRACE_SPAN_FMT("long_{}_{}", std::string(200, 'x'), 5);
+    }
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    REQUIRE(lines_containing(test_file, "\"name\":\"steal_from_1_to_2\"").size() == 1);
+    auto long_name = lines_containing(test_file, "\"name\":\"long_xx");
+    REQUIRE(long_name.size() == 1);
+    REQUIRE(long_name[0].find("_{?}...\"") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "TRACE_SPAN_FMT sites are matched by their format", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_sites.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    set_span_enabled("steal_from_*", false);
+    steal(4, 5);
+    set_span_enabled("steal_from_*", true);
+    steal(6, 7);
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "steal_from_4_to_5").empty());
+    REQUIRE(lines_containing(test_file, "steal_from_6_to_7").size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Unsampled TRACE_SPAN_FMT is expanded when a budget keeps it", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_budget.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    {
+        TRACE_SPAN_BUDGET("fmt_budget_parent", 1ms);
+        steal(8, 9);
+        std::this_thread::sleep_for(5ms);
+    }
+    {
+        TRACE_SPAN_BUDGET("fmt_budget_parent", 1s);
+        steal(10, 11);
+    }
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "\"name\":\"steal_from_8_to_9\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "steal_from_10_to_11").empty());
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Unsampled TRACE_SPAN_FMT is expanded when an error keeps it", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_error.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+
+    steal_failing(4, 2);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "\"name\":\"failed_steal_child\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "\"name\":\"failed_steal_4_to_2\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "{}").empty());
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Span names are kept raw and escaped once when written", "[span_fmt]") {
+    const std::string test_file = "test_span_fmt_escaping.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    set_buffer_mode(BufferMode::mpsc);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    { TraceSpan span("say \"hi\""); }
+    {
+        std::string path = "C:\\tmp";
+        TRACE_SPAN_FMT("open {}", path);
+        TraceSpan child("open_child");
+        child.set_error(2, "missing");
+    }
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, R"x("name":"say \"hi\"")x").size() == 1);
+    REQUIRE(lines_containing(test_file, R"x("name":"open C:\\tmp")x").size() == 1);
+
+    std::remove(test_file.c_str());
+}
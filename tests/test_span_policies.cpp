@@ -0,0 +1,186 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Advances only when told to.
+struct FakeClock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<FakeClock, duration>;
+
+    static inline duration now_ns{1000000};
+
+    static time_point now() { return time_point(now_ns); }
+};
+
+// Counts raw ticks of 2.5 ns, like a TSC at 400 MHz, and only scales them
+// when a span closes.
+struct TickClock {
+    using duration = std::chrono::duration<int64_t>; // ticks, not seconds
+    using time_point = std::chrono::time_point<TickClock, duration>;
+
+    static inline int64_t ticks = 0;
+
+    static time_point now() { return time_point(duration(ticks)); }
+    static std::chrono::nanoseconds to_nanoseconds(duration d) {
+        return std::chrono::nanoseconds(d.count() * 5 / 2);
+    }
+};
+
+// Jumps a second ahead on every read.
+struct JumpClock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<JumpClock, duration>;
+
+    static inline duration now_ns{0};
+
+    static time_point now() { return time_point(now_ns += 1s); }
+};
+
+struct CapturedEmit {
+    std::string name;
+    uint64_t span_id;
+    uint64_t parent_id;
+    std::chrono::nanoseconds duration;
+    bool over_budget;
+};
+
+struct CaptureSink {
+    static inline std::vector<CapturedEmit> emitted;
+
+    static void emit(TraceBackend&, std::string_view name, uint64_t span_id, uint64_t parent_id,
+                     std::chrono::nanoseconds duration, uint32_t,
+                     std::chrono::nanoseconds budget, const detail::SpanArgs*,
+                     const detail::SpanError*) {
+        emitted.push_back({std::string(name), span_id, parent_id, duration, budget.count() != 0});
+    }
+};
+
+using FakeSpan = BasicTraceSpan<FakeClock, StaticName, CaptureSink>;
+
+} // namespace
+
+TEST_CASE("TraceSpan is BasicTraceSpan with the default policies", "[policies]") {
+    STATIC_REQUIRE(std::is_same_v<TraceSpan, BasicTraceSpan<clock_type, OwnedName, BackendSink>>);
+    STATIC_REQUIRE(std::is_same_v<BasicTraceSpan<clock_type, StaticName>::name_type, const char*>);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "A fake clock gives exact span durations", "[policies]") {
+    configure([](TraceConfig& c) {
+        c.sample_rate = 1.0;
+        c.min_duration_ns = 0;
+    });
+    CaptureSink::emitted.clear();
+
+    {
+        FakeSpan outer("policy_outer");
+        FakeClock::now_ns += 250us;
+        {
+            FakeSpan inner("policy_inner");
+            FakeClock::now_ns += 1500us;
+        }
+        REQUIRE(CaptureSink::emitted.size() == 1);
+        REQUIRE(CaptureSink::emitted[0].parent_id == outer.span_id());
+    }
+
+    REQUIRE(CaptureSink::emitted.size() == 2);
+    REQUIRE(CaptureSink::emitted[0].name == "policy_inner");
+    REQUIRE(CaptureSink::emitted[0].duration == 1500us);
+    REQUIRE(CaptureSink::emitted[1].name == "policy_outer");
+    REQUIRE(CaptureSink::emitted[1].duration == 1750us);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "A clock's own time_point is scaled when the span closes", "[policies]") {
+    configure([](TraceConfig& c) {
+        c.sample_rate = 1.0;
+        c.min_duration_ns = 0;
+    });
+    CaptureSink::emitted.clear();
+
+    {
+        BasicTraceSpan<TickClock, StaticName, CaptureSink> span("policy_ticks");
+        TickClock::ticks += 400000; // 1 ms
+    }
+
+    REQUIRE(CaptureSink::emitted.size() == 1);
+    REQUIRE(CaptureSink::emitted[0].duration == 1ms);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Budgets use the policy clock and sink", "[policies]") {
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+    CaptureSink::emitted.clear();
+
+    {
+        FakeSpan within("policy_within", 1ms);
+        FakeSpan child("policy_child_within");
+        FakeClock::now_ns += 500us;
+    }
+    REQUIRE(CaptureSink::emitted.empty());
+    {
+        FakeSpan over("policy_over", 1ms);
+        {
+            FakeSpan child("policy_child_over");
+            FakeClock::now_ns += 2ms;
+        }
+    }
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    // The held child is replayed through its sink, then the overrun span.
+    REQUIRE(CaptureSink::emitted.size() == 2);
+    REQUIRE(CaptureSink::emitted[0].name == "policy_child_over");
+    REQUIRE(CaptureSink::emitted[1].name == "policy_over");
+    REQUIRE(CaptureSink::emitted[1].over_budget);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "StaticName spans reach the backend like TraceSpan", "[policies]") {
+    const std::string test_file = "test_span_policies.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    {
+        TraceSpan parent("policy_parent");
+        BasicTraceSpan<clock_type, StaticName> child("policy_static_child");
+    }
+    flush_traces();
+
+    REQUIRE(lines_containing(test_file, "\"name\":\"policy_parent\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "\"name\":\"policy_static_child\"").size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Watchdog and overhead timing ignore the policy clock", "[policies]") {
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    CaptureSink::emitted.clear();
+
+    {
+        FakeSpan span("policy_open_fake");
+        auto open = open_spans();
+        auto it = std::find_if(open.begin(), open.end(), [](const OpenSpan& s) {
+            return s.name == "policy_open_fake";
+        });
+        REQUIRE(it != open.end());
+        // FakeClock's epoch is near zero; the watchdog needs clock_type's.
+        REQUIRE(detail::now_ns() - it->start_ns >= 0);
+        REQUIRE(detail::now_ns() - it->start_ns < 1000000000);
+    }
+
+    // Every span that times its own overhead would add a JumpClock second.
+    for (uint32_t i = 0; i < 2 * kOverheadSampleInterval; ++i) {
+        BasicTraceSpan<JumpClock, StaticName, CaptureSink> span("policy_jump");
+    }
+    REQUIRE(tracer_metrics().span_overhead_ns < 1000000);
+}
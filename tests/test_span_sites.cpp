@@ -0,0 +1,107 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <fstream>
+#include <string>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+uint64_t traced_net_call() {
+    TRACE_SPAN("site_net_roundtrip");
+    return TraceContext::instance().current_span_id();
+}
+
+uint64_t traced_serialize() {
+    TRACE_SPAN("site_serialize_request");
+    return TraceContext::instance().current_span_id();
+}
+
+void traced_by_name(const std::string& name) {
+    TRACE_SPAN(name);
+}
+
+void traced_by_pointer(const char* name) {
+    TRACE_SPAN(name);
+}
+
+} // namespace
+
+TEST_CASE("Glob matching supports * and ?", "[sites]") {
+    REQUIRE(detail::glob_match("*", "anything"));
+    REQUIRE(detail::glob_match("net_*", "net_roundtrip"));
+    REQUIRE(detail::glob_match("*_request", "serialize_request"));
+    REQUIRE(detail::glob_match("cache_?et", "cache_get"));
+    REQUIRE_FALSE(detail::glob_match("net_*", "cache_get"));
+    REQUIRE_FALSE(detail::glob_match("cache_?et", "cache_reset"));
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Disabled TRACE_SPAN sites do nothing", "[sites]") {
+    const std::string test_file = "test_span_sites.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    // Rule set before the site first runs still applies to it.
+    set_span_enabled("site_serialize_*", false);
+
+    TraceSpan outer("site_outer");
+    REQUIRE(traced_serialize() == outer.span_id()); // no span pushed
+    REQUIRE(traced_net_call() != outer.span_id());
+
+    set_span_enabled("site_net_*", false);
+    REQUIRE(traced_net_call() == outer.span_id());
+
+    set_span_enabled("*", true);
+    REQUIRE(traced_serialize() != outer.span_id());
+
+    flush_traces();
+    REQUIRE(count_lines_containing(test_file, "site_serialize_request") == 1);
+    REQUIRE(count_lines_containing(test_file, "site_net_roundtrip") == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Config disabled_spans toggles sites", "[sites][config]") {
+    configure([](TraceConfig& c) { c.disabled_spans = "site_net_*, other_*"; });
+    TraceSpan outer("site_outer");
+    REQUIRE(traced_net_call() == outer.span_id());
+
+    configure([](TraceConfig& c) { c.disabled_spans.clear(); });
+    REQUIRE(traced_net_call() != outer.span_id());
+
+    bool found = false;
+    SiteRegistry::instance().for_each([&](const SpanSite& site) {
+        found = found || std::string(site.name()) == "site_net_roundtrip";
+    });
+    REQUIRE(found);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "TRACE_SPAN names the span per call unless given a literal", "[sites]") {
+    const std::string test_file = "test_span_sites_runtime.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    traced_by_name("site_runtime_a");
+    traced_by_name("site_runtime_b");
+    std::string buffer = "site_pointer_a";
+    traced_by_pointer(buffer.c_str());
+    buffer = "site_pointer_b";
+    traced_by_pointer(buffer.c_str());
+    // Site rules only apply to literal names.
+    set_span_enabled("site_runtime_*", false);
+    traced_by_name("site_runtime_c");
+    set_span_enabled("*", true);
+    flush_traces();
+
+    REQUIRE(count_lines_containing(test_file, "\"name\":\"site_runtime_a\"") == 1);
+    REQUIRE(count_lines_containing(test_file, "\"name\":\"site_runtime_b\"") == 1);
+    REQUIRE(count_lines_containing(test_file, "\"name\":\"site_runtime_c\"") == 1);
+    REQUIRE(count_lines_containing(test_file, "\"name\":\"site_pointer_a\"") == 1);
+    REQUIRE(count_lines_containing(test_file, "\"name\":\"site_pointer_b\"") == 1);
+
+    std::remove(test_file.c_str());
+}
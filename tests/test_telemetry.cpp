@@ -0,0 +1,99 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "Metrics count recorded and filtered spans", "[telemetry]") {
+    const std::string test_file = "test_telemetry_counts.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    TracerMetrics before = tracer_metrics();
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+    for (int i = 0; i < 10; ++i) {
+        TraceSpan dropped("telemetry_unsampled");
+    }
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    for (int i = 0; i < 5; ++i) {
+        TraceSpan kept("telemetry_sampled");
+    }
+    flush_traces();
+    TracerMetrics after = tracer_metrics();
+
+    REQUIRE(after.spans_filtered - before.spans_filtered == 10);
+    REQUIRE(after.spans_recorded - before.spans_recorded == 5);
+    REQUIRE(after.bytes_written > before.bytes_written);
+    REQUIRE(after.write_ns > before.write_ns);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Metrics track buffer depth and writer lag", "[telemetry]") {
+    const std::string test_file = "test_telemetry_buffered.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    set_buffer_mode(BufferMode::mpsc);
+
+    for (int i = 0; i < 100; ++i) {
+        TraceSpan span("telemetry_buffered");
+    }
+    TracerMetrics queued = tracer_metrics();
+    REQUIRE(queued.buffer_high_water >= 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    flush_traces();
+    TracerMetrics drained = tracer_metrics();
+    set_buffer_mode(BufferMode::direct);
+
+    REQUIRE(drained.buffered == 0);
+    REQUIRE(drained.writer_lag_max_ns > 0);
+    REQUIRE(drained.writer_lag_max_ns >= drained.writer_lag_ns);
+    REQUIRE(lines_containing(test_file, "telemetry_buffered").size() == 100);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Sampled spans estimate the per-span overhead", "[telemetry]") {
+    TracerMetrics before = tracer_metrics();
+    configure([](TraceConfig& c) { c.sample_rate = 0.0; });
+    for (uint32_t i = 0; i < kOverheadSampleInterval * 2; ++i) {
+        TraceSpan span("telemetry_overhead");
+    }
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    TracerMetrics after = tracer_metrics();
+
+    REQUIRE(after.overhead_samples - before.overhead_samples == 2);
+    REQUIRE(after.span_overhead_ns > 0);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Telemetry interval writes tracer_stats records", "[telemetry]") {
+    const std::string test_file = "test_telemetry_records.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) {
+        c.sample_rate = 1.0;
+        c.telemetry_interval_ms = 1;
+    });
+
+    for (int i = 0; i < 5; ++i) {
+        TraceSpan span("telemetry_periodic");
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    }
+    configure([](TraceConfig& c) { c.telemetry_interval_ms = 0; });
+    flush_traces();
+
+    auto stats = lines_containing(test_file, "\"type\":\"tracer_stats\"");
+    REQUIRE(stats.size() >= 2);
+    REQUIRE(stats.back().find("\"spans_recorded\":") != std::string::npos);
+    REQUIRE(stats.back().find("\"span_overhead_ns\":") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "Spans carry a thread index described once per thread", "[threads]") {
+    const std::string test_file = "test_threads_index.jsonl";
+    std::remove(test_file.c_str());
+    set_buffer_mode(BufferMode::mpsc);
+    set_trace_output(test_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    uint32_t worker_index = 0;
+    std::thread worker([&worker_index]() {
+        worker_index = detail::thread_index();
+        TraceSpan first("indexed_first");
+        TraceSpan second("indexed_second");
+    });
+    worker.join();
+    flush_traces();
+    set_buffer_mode(BufferMode::direct);
+
+    REQUIRE(worker_index != 0);
+    REQUIRE(worker_index != detail::thread_index());
+    std::string index = std::to_string(worker_index);
+    auto spans = lines_containing(test_file, "\"indexed_");
+    REQUIRE(spans.size() == 2);
+    for (const auto& span : spans) {
+        REQUIRE(field(span, "thread_id") == index);
+    }
+    auto records = lines_containing(test_file, "\"type\":\"thread\",\"thread_id\":" + index + ",");
+    REQUIRE(records.size() == 1);
+    REQUIRE(std::stoll(field(records[0], "tid")) > 0);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "A new output file starts with the known threads", "[threads]") {
+    const std::string test_file = "test_threads_header.jsonl";
+    std::remove(test_file.c_str());
+    uint32_t self = detail::thread_index();
+    set_trace_output(test_file);
+    flush_traces();
+
+    std::string needle = "\"type\":\"thread\",\"thread_id\":" + std::to_string(self) + ",";
+    REQUIRE(lines_containing(test_file, needle).size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "set_thread_name renames the thread in the OS and the trace", "[threads]") {
+    const std::string test_file = "test_threads_name.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    std::string os_name;
+    uint32_t index = 0;
+    std::thread worker([&]() {
+        set_thread_name("tinytrace-worker-with-a-long-name");
+        index = detail::thread_index();
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        os_name = name;
+    });
+    worker.join();
+    flush_traces();
+
+    REQUIRE(os_name == "tinytrace-worke");
+    auto records = lines_containing(test_file, "\"name\":\"tinytrace-worker-with-a-long-name\"");
+    REQUIRE(records.size() == 1);
+    REQUIRE(field(records[0], "thread_id") == std::to_string(index));
+
+    std::remove(test_file.c_str());
+}
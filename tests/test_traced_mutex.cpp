@@ -0,0 +1,115 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+LockStatsSnapshot stats_named(const std::string& name) {
+    for (auto& stats : lock_stats()) {
+        if (stats.name == name) {
+            return stats;
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+TEST_CASE_METHOD(GlobalTracerState, "Uncontended TracedMutex records no wait span", "[mutex]") {
+    const std::string test_file = "test_mutex_uncontended.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    TracedMutex mutex("quiet_lock");
+    for (uint32_t i = 0; i < kLockHoldSampleInterval * 4; ++i) {
+        std::lock_guard<TracedMutex> lock(mutex);
+    }
+    REQUIRE(mutex.try_lock());
+    bool other_got_it = true;
+    std::thread([&]() { other_got_it = mutex.try_lock(); }).join();
+    REQUIRE_FALSE(other_got_it);
+    mutex.unlock();
+    flush_traces();
+
+    REQUIRE(count_lines_containing(test_file, "quiet_lock.wait") == 0);
+    auto stats = stats_named("quiet_lock");
+    REQUIRE(stats.contended == 0);
+    REQUIRE(stats.hold_samples == 4);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Contended TracedMutex records a wait span and wait time", "[mutex]") {
+    const std::string test_file = "test_mutex_contended.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    TracedMutex mutex("busy_lock");
+    std::unique_lock<TracedMutex> held(mutex);
+    std::thread waiter([&]() {
+        TraceSpan request("request_needing_lock");
+        std::lock_guard<TracedMutex> lock(mutex);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    held.unlock();
+    waiter.join();
+    flush_traces();
+
+    REQUIRE(count_lines_containing(test_file, "\"busy_lock.wait\"") == 1);
+    auto stats = stats_named("busy_lock");
+    REQUIRE(stats.contended == 1);
+    REQUIRE(stats.wait_ns >= 10000000);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Hold-time histogram is shared per name", "[mutex]") {
+    TracedMutex a("shared_name_lock");
+    TracedMutex b("shared_name_lock");
+    for (uint32_t i = 0; i < kLockHoldSampleInterval; ++i) {
+        std::lock_guard<TracedMutex> la(a);
+        std::lock_guard<TracedMutex> lb(b);
+        if (i == kLockHoldSampleInterval - 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    auto stats = stats_named("shared_name_lock");
+    REQUIRE(stats.hold_samples == 2);
+    REQUIRE(stats.hold_percentile_ns(0.5) >= 2000000);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "TracedSharedMutex works with shared_lock", "[mutex]") {
+    const std::string test_file = "test_mutex_shared.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    TracedSharedMutex mutex("rw_lock");
+    {
+        std::shared_lock<TracedSharedMutex> r1(mutex);
+        std::shared_lock<TracedSharedMutex> r2(mutex);
+        REQUIRE_FALSE(mutex.try_lock());
+    }
+
+    std::unique_lock<TracedSharedMutex> writer(mutex);
+    std::thread reader([&]() { std::shared_lock<TracedSharedMutex> r(mutex); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    writer.unlock();
+    reader.join();
+    flush_traces();
+
+    REQUIRE(count_lines_containing(test_file, "\"rw_lock.wait\"") == 1);
+    REQUIRE(stats_named("rw_lock").contended == 1);
+
+    std::remove(test_file.c_str());
+}
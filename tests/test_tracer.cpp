@@ -0,0 +1,141 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+TEST_CASE_METHOD(GlobalTracerState, "Tracers write to their own outputs", "[tracer]") {
+    const std::string global_file = "test_tracer_global.jsonl";
+    const std::string a_file = "test_tracer_a.jsonl";
+    const std::string b_file = "test_tracer_b.jsonl";
+    std::remove(global_file.c_str());
+    std::remove(a_file.c_str());
+    std::remove(b_file.c_str());
+    set_trace_output(global_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    {
+        Tracer a;
+        Tracer b;
+        a.set_output(a_file);
+        b.set_output(b_file);
+        b.set_buffer_mode(BufferMode::mpsc);
+
+        { TraceSpan span(a, "tracer_a_span"); }
+        { TraceSpan span(b, "tracer_b_span"); }
+        { TraceSpan span("tracer_global_span"); }
+        a.flush();
+        b.flush();
+        flush_traces();
+
+        REQUIRE(a.metrics().spans_recorded == 1);
+        REQUIRE(Tracer::global().metrics().spans_recorded >= 1);
+    }
+
+    REQUIRE(lines_containing(a_file, "\"name\":\"tracer_a_span\"").size() == 1);
+    REQUIRE(lines_containing(a_file, "\"duration_us\"").size() == 1);
+    REQUIRE(lines_containing(b_file, "\"name\":\"tracer_b_span\"").size() == 1);
+    REQUIRE(lines_containing(b_file, "\"duration_us\"").size() == 1);
+    REQUIRE(lines_containing(global_file, "\"name\":\"tracer_global_span\"").size() == 1);
+    REQUIRE(lines_containing(global_file, "tracer_a_span").empty());
+    REQUIRE(lines_containing(global_file, "tracer_b_span").empty());
+
+    std::remove(global_file.c_str());
+    std::remove(a_file.c_str());
+    std::remove(b_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Tracer config is independent of the global one", "[tracer]") {
+    const std::string test_file = "test_tracer_config.jsonl";
+    std::remove(test_file.c_str());
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    TraceConfig config;
+    config.output = test_file;
+    config.sample_rate = 0.0;
+    Tracer tracer(config);
+    REQUIRE(Tracer::global().config().sample_rate == 1.0);
+
+    { TraceSpan span(tracer, "tracer_unsampled"); }
+    tracer.configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    { TraceSpan span(tracer, "tracer_sampled"); }
+    tracer.flush();
+
+    REQUIRE(lines_containing(test_file, "tracer_unsampled").empty());
+    REQUIRE(lines_containing(test_file, "\"name\":\"tracer_sampled\"").size() == 1);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Tracer spans nest under the thread's open span", "[tracer]") {
+    const std::string test_file = "test_tracer_nested.jsonl";
+    std::remove(test_file.c_str());
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+
+    Tracer tracer;
+    tracer.set_output(test_file);
+    uint64_t outer_id = 0;
+    {
+        TraceSpan outer(tracer, "tracer_outer");
+        outer_id = outer.span_id();
+        TraceSpan inner(tracer, "tracer_inner");
+        REQUIRE(inner.parent_id() == outer_id);
+        inner.event("tracer_event", "n", 1);
+    }
+    std::thread([&tracer]() { TraceSpan span(tracer, "tracer_worker"); }).join();
+    tracer.flush();
+
+    auto inner = lines_containing(test_file, "\"name\":\"tracer_inner\"");
+    REQUIRE(inner.size() == 1);
+    REQUIRE(field(inner[0], "parent_id") == std::to_string(outer_id));
+    REQUIRE(lines_containing(test_file, "tracer_event").size() == 1);
+    // The worker's thread record reached this tracer's output too.
+    auto worker = lines_containing(test_file, "\"name\":\"tracer_worker\"");
+    REQUIRE(worker.size() == 1);
+    REQUIRE(lines_containing(test_file, "\"type\":\"thread\"").size() >= 2);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Tracer filters leave the global site rules alone", "[tracer]") {
+    const std::string global_file = "test_tracer_rules_global.jsonl";
+    const std::string test_file = "test_tracer_rules.jsonl";
+    std::remove(global_file.c_str());
+    std::remove(test_file.c_str());
+    set_trace_output(global_file);
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    set_span_enabled("tracer_db_*", false);
+
+    {
+        TraceConfig config;
+        config.output = test_file;
+        config.disabled_spans = "tracer_net_*";
+        Tracer tracer(config);
+
+        { TraceSpan span(tracer, "tracer_net_call"); }
+        { TraceSpan span(tracer, "tracer_disk_read"); }
+        tracer.configure([](TraceConfig& c) { c.category_mask = 0; });
+        { TraceSpan span(tracer, "tracer_masked"); }
+        tracer.flush();
+    }
+    { TRACE_SPAN("tracer_db_query"); }
+    { TRACE_SPAN("tracer_net_reply"); }
+    flush_traces();
+    set_span_enabled("*", true);
+
+    REQUIRE(lines_containing(test_file, "tracer_net_call").empty());
+    REQUIRE(lines_containing(test_file, "\"name\":\"tracer_disk_read\"").size() == 1);
+    REQUIRE(lines_containing(test_file, "tracer_masked").empty());
+    REQUIRE(lines_containing(global_file, "tracer_db_query").empty());
+    REQUIRE(lines_containing(global_file, "\"name\":\"tracer_net_reply\"").size() == 1);
+
+    std::remove(global_file.c_str());
+    std::remove(test_file.c_str());
+}
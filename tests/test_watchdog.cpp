@@ -0,0 +1,144 @@
+#include <catch2/catch_test_macros.hpp>
+#include <tinytrace/tinytrace.hpp>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_helpers.hpp"
+
+using namespace tinytrace;
+using namespace test_helpers;
+
+namespace {
+
+std::vector<OpenSpan> open_spans_named(const std::string& name) {
+    std::vector<OpenSpan> found;
+    for (auto& span : open_spans()) {
+        if (span.name == name) {
+            found.push_back(span);
+        }
+    }
+    return found;
+}
+
+} // namespace
+
+TEST_CASE("Open spans are visible from other threads until they close", "[watchdog]") {
+    std::atomic<bool> opened{false};
+    std::atomic<bool> release{false};
+    std::thread worker([&]() {
+        TraceSpan outer("visible_outer");
+        TraceSpan inner("visible_inner");
+        opened = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+    });
+    while (!opened) {
+        std::this_thread::yield();
+    }
+
+    auto outer = open_spans_named("visible_outer");
+    auto inner = open_spans_named("visible_inner");
+    REQUIRE(outer.size() == 1);
+    REQUIRE(inner.size() == 1);
+    REQUIRE(inner[0].parent_id == outer[0].span_id);
+    REQUIRE(inner[0].thread_id == outer[0].thread_id);
+    REQUIRE(inner[0].start_ns >= outer[0].start_ns);
+
+    release = true;
+    worker.join();
+    REQUIRE(open_spans_named("visible_outer").empty());
+    REQUIRE(open_spans_named("visible_inner").empty());
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Watchdog reports the innermost hung span once, with ancestry", "[watchdog]") {
+    configure([](TraceConfig& c) { c.sample_rate = 1.0; });
+    std::mutex mutex;
+    std::vector<HungSpan> reports;
+    WatchdogOptions options;
+    options.deadline = std::chrono::milliseconds(30);
+    options.interval = std::chrono::milliseconds(5);
+    options.on_hung = [&](const HungSpan& hung) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reports.push_back(hung);
+    };
+    start_watchdog(options);
+    REQUIRE(SpanWatchdog::instance().running());
+
+    {
+        TraceSpan request("hung_request");
+        TraceSpan handler("hung_handler");
+        // A child on a pool thread: ancestry follows parent ids across it.
+        TracedExecutor pool("hung_pool", 1);
+        pool.submit([]() {
+            TraceSpan query("hung_query");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        });
+        pool.wait_idle();
+        {
+            TraceSpan quick("fast_child");
+        }
+    }
+    stop_watchdog();
+    REQUIRE_FALSE(SpanWatchdog::instance().running());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(reports.size() >= 1);
+    std::size_t query_reports = 0;
+    for (const auto& hung : reports) {
+        REQUIRE(hung.span.name != "fast_child");
+        REQUIRE(hung.open_ns >= 30000000);
+        if (hung.span.name == "hung_query") {
+            ++query_reports;
+            REQUIRE(hung.ancestry.size() == 3);
+            REQUIRE(hung.ancestry[0].name == "hung_pool.run");
+            REQUIRE(hung.ancestry[1].name == "hung_handler");
+            REQUIRE(hung.ancestry[2].name == "hung_request");
+            REQUIRE(hung.ancestry[2].thread_id != hung.span.thread_id);
+        }
+    }
+    REQUIRE(query_reports == 1);
+}
+
+TEST_CASE_METHOD(GlobalTracerState, "Hung spans are written to the trace with their ancestry", "[watchdog]") {
+    const std::string test_file = "test_watchdog_output.jsonl";
+    std::remove(test_file.c_str());
+    set_trace_output(test_file);
+
+    WatchdogOptions options;
+    options.deadline = std::chrono::milliseconds(20);
+    options.interval = std::chrono::milliseconds(5);
+    start_watchdog(options);
+    {
+        TraceSpan outer("stuck_outer");
+        TraceSpan inner("stuck_inner");
+        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    }
+    stop_watchdog();
+    flush_traces();
+
+    auto hung = lines_containing(test_file, "\"type\":\"hung_span\"");
+    REQUIRE(hung.size() == 1);
+    REQUIRE(hung[0].find("\"name\":\"stuck_inner\"") != std::string::npos);
+    REQUIRE(hung[0].find("\"ancestry\":[{\"name\":\"stuck_outer\"") != std::string::npos);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Hung span names are escaped in JSON", "[watchdog]") {
+    HungSpan hung;
+    hung.span.name = "load \"config\"";
+    hung.span.span_id = 2;
+    hung.ancestry.push_back({1, 0, "C:\\jobs", 0, 0});
+
+    std::ostringstream out;
+    format_hung_span_json(out, hung);
+    REQUIRE(out.str().find(R"("name":"load \"config\"")") != std::string::npos);
+    REQUIRE(out.str().find(R"("ancestry":[{"name":"C:\\jobs")") != std::string::npos);
+}